@@ -8,7 +8,7 @@ if exists("b:current_syntax")
 endif
 
 " Keywords
-syntax keyword pluxKeyword cleanup doc enddoc function endfunction call shell process
+syntax keyword pluxKeyword cleanup doc enddoc function endfunction parallel endparallel call shell process
 syntax keyword pluxDebug log
 syntax keyword pluxInclude include
 syntax keyword pluxDefine local global
@@ -22,6 +22,7 @@ syntax match pluxMatch "^\s*?{1,3}.*$"
 " Regions
 syntax region pluxDoc start="\[doc\]" end="\[enddoc\]"
 syntax region pluxFunction start="\[function.*\]" end="\[endfunction\]"
+syntax region pluxParallel start="\[parallel\]" end="\[endparallel\]"
 
 " Hightlight
 highlight link pluxComment Comment
@@ -0,0 +1,135 @@
+#include "ansi_strip.hh"
+
+#include <cstring>
+
+namespace plux
+{
+    static const char ESC = 0x1b;
+    static const char BEL = 0x07;
+
+    AnsiStrip::AnsiStrip(void)
+        : _state(STATE_GROUND)
+    {
+    }
+
+    /**
+     * Strip escape sequences from data, setting out to the remaining
+     * text. Returns false, leaving out untouched, if data has nothing
+     * to strip and can be used as is.
+     *
+     * Text between sequences is found with memchr, vectorized by the
+     * C library, and appended in one go.
+     */
+    bool AnsiStrip::strip(const char* data, size_t size, std::string& out)
+    {
+        const char* esc = nullptr;
+        if (_state == STATE_GROUND) {
+            esc = static_cast<const char*>(memchr(data, ESC, size));
+            if (esc == nullptr) {
+                return false;
+            }
+        }
+
+        out.clear();
+        size_t i = 0;
+        while (i < size) {
+            if (_state != STATE_GROUND) {
+                if (skip(data[i], out)) {
+                    i++;
+                }
+                continue;
+            }
+
+            if (esc == nullptr) {
+                esc = static_cast<const char*>(
+                    memchr(data + i, ESC, size - i));
+            }
+            size_t end = esc ? esc - data : size;
+            out.append(data + i, end - i);
+            if (esc == nullptr) {
+                break;
+            }
+            _state = STATE_ESC;
+            i = end + 1;
+            esc = nullptr;
+        }
+        return true;
+    }
+
+    /**
+     * Process byte in a sequence, returns false if the byte starts a
+     * new sequence and must be processed again. Bytes that can not be
+     * part of the sequence end it and are kept, a newline never ends
+     * up inside a sequence.
+     */
+    bool AnsiStrip::skip(unsigned char c, std::string& out)
+    {
+        switch (_state) {
+        case STATE_ESC:
+            if (c == '[') {
+                _state = STATE_CSI;
+            } else if (c == ']' || c == 'P' || c == 'X' || c == '^'
+                       || c == '_') {
+                _state = STATE_STRING;
+            } else if (c == ESC) {
+                // new sequence
+            } else if (c >= 0x20 && c <= 0x2f) {
+                _state = STATE_ESC_INTER;
+            } else if (c >= 0x30 && c <= 0x7e) {
+                _state = STATE_GROUND;
+            } else {
+                out += c;
+                _state = STATE_GROUND;
+            }
+            break;
+        case STATE_ESC_INTER:
+            if (c >= 0x20 && c <= 0x2f) {
+                // more intermediate bytes
+            } else if (c >= 0x30 && c <= 0x7e) {
+                _state = STATE_GROUND;
+            } else if (c == ESC) {
+                _state = STATE_ESC;
+            } else {
+                out += c;
+                _state = STATE_GROUND;
+            }
+            break;
+        case STATE_CSI:
+            if (c >= 0x20 && c <= 0x3f) {
+                // parameter and intermediate bytes
+            } else if (c >= 0x40 && c <= 0x7e) {
+                _state = STATE_GROUND;
+            } else if (c == ESC) {
+                _state = STATE_ESC;
+            } else {
+                out += c;
+                _state = STATE_GROUND;
+            }
+            break;
+        case STATE_STRING:
+            if (c == BEL) {
+                _state = STATE_GROUND;
+            } else if (c == ESC) {
+                _state = STATE_STRING_ESC;
+            } else if (c == '\n') {
+                // unterminated, do not swallow the following lines
+                out += c;
+                _state = STATE_GROUND;
+            }
+            break;
+        case STATE_STRING_ESC:
+            if (c == '\\') {
+                _state = STATE_GROUND;
+            } else {
+                // not a string terminator, start of a new sequence
+                _state = STATE_ESC;
+                return false;
+            }
+            break;
+        case STATE_GROUND:
+            out += c;
+            break;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace plux
+{
+    /**
+     * Streaming removal of ANSI escape sequences from shell output.
+     *
+     * Handles CSI (ESC [), OSC (ESC ]) and the DCS, SOS, PM and APC
+     * string sequences along with two byte escapes. State is kept
+     * between calls so sequences split across reads are removed.
+     */
+    class AnsiStrip {
+    public:
+        AnsiStrip(void);
+
+        bool strip(const char* data, size_t size, std::string& out);
+
+    private:
+        enum state {
+            /** Plain text. */
+            STATE_GROUND,
+            /** After ESC. */
+            STATE_ESC,
+            /** After ESC and intermediate bytes. */
+            STATE_ESC_INTER,
+            /** In control sequence, ESC [. */
+            STATE_CSI,
+            /** In string sequence, terminated by BEL or ESC \. */
+            STATE_STRING,
+            /** After ESC in string sequence. */
+            STATE_STRING_ESC
+        };
+
+        bool skip(unsigned char c, std::string& out);
+
+        enum state _state;
+    };
+}
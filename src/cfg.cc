@@ -2,9 +2,10 @@
 
 #include "cfg.hh"
 #include "os.hh"
+#include "plux.hh"
 
 Cfg::Cfg(void)
-    : _log_dir("plux"),
+    : _log_dir(plux::default_log_dir()),
       _stdlib_dir(PLUX_STDLIB_PATH)
 {
     plux::os_ensure_dir(_log_dir);
@@ -1,57 +1,15 @@
+#include <algorithm>
+
 #include "line.hh"
 #include "script.hh"
 
 #define IS_VAR_CHAR(c) (isalnum((c)) || (c) == '_')
 
-struct ExpandState {
-    ExpandState(const plux::ShellEnv& env_, const std::string& shell_)
-        : env(env_),
-          shell(shell_)
-    {
-    }
-
-    const plux::ShellEnv& env;
-    const std::string& shell;
-
-    std::string exp_line;
-
-    bool in_var = false;
-    bool var_curly = false;
-    std::string var_name;
-};
-
-static void
-_expand_var_begin(ExpandState& s, std::string::const_iterator& it,
-                  const std::string::const_iterator& last)
-{
-    if (it == last) {
-        // last character
-        s.exp_line += '$';
-    } else {
-        // skip to next character, determines variable type.
-        ++it;
-
-        if (*it == '$') {
-            s.exp_line += '$';
-        } else if (*it == '{') {
-            s.in_var = true;
-            s.var_curly = true;
-            s.var_name = "";
-        } else if (IS_VAR_CHAR(*it)) {
-            s.in_var = true;
-            s.var_curly = false;
-            s.var_name = *it;
-        } else {
-            throw plux::ScriptError(s.shell, "empty variable name");
-        }
-    }
-}
-
 static std::string
 re_escape_val(const std::string val)
 {
     auto it(val.begin());
-    bool in_escape;
+    bool in_escape = false;
     std::string escaped;
     for (; it != val.end(); ++it) {
         if (in_escape) {
@@ -87,45 +45,7 @@ namespace plux
     std::string expand_var(const ShellEnv& env, const std::string& shell,
                            const std::string& line)
     {
-        ExpandState s(env, shell);
-
-        auto it(line.begin());
-        auto last(line.end() - 1);
-        for (; it != line.end(); ++it) {
-            if (s.in_var) {
-                if (s.var_curly) {
-                    if (*it == '}') {
-                        s.in_var = false;
-                        append_var_val(env, shell, s.exp_line, s.var_name);
-                    } else {
-                        s.var_name += *it;
-                    }
-                } else if (IS_VAR_CHAR(*it)) {
-                    s.var_name += *it;
-                } else {
-                    s.in_var = false;
-                    append_var_val(env, shell, s.exp_line, s.var_name);
-                    if (*it == '$') {
-                        _expand_var_begin(s, it, last);
-                    } else {
-                        s.exp_line += *it;
-                    }
-                }
-            } else if (*it == '$') {
-                _expand_var_begin(s, it, last);
-            } else {
-                s.exp_line += *it;
-            }
-        }
-
-        if (s.in_var) {
-            if (s.var_curly) {
-                throw ScriptError(shell, "end of line while scanning for }");
-            }
-            append_var_val(env, shell, s.exp_line, s.var_name);
-        }
-
-        return s.exp_line;
+        return VarTemplate(line).expand(env, shell);
     }
 
     void append_var_val(const ShellEnv& env, const std::string& shell,
@@ -157,4 +77,165 @@ namespace plux
             exp_str += var_val;
         }
     }
+
+    /**
+     * Compile str, $VAR, ${VAR} and ${=VAR} are variable references and
+     * $$ is a single $. A $ at the end of str is kept as is.
+     *
+     * Invalid references are compiled into an error segment, thrown
+     * when expanded, so errors are reported with the shell the line
+     * runs in.
+     */
+    VarTemplate::VarTemplate(const std::string& str)
+        : _str(str),
+          _literal_size(0)
+    {
+        std::string literal;
+        size_t i = 0;
+        while (i < str.size()) {
+            if (str[i] != '$') {
+                size_t end = str.find('$', i);
+                if (end == std::string::npos) {
+                    end = str.size();
+                }
+                literal.append(str, i, end - i);
+                i = end;
+            } else if (i + 1 == str.size()) {
+                // last character
+                literal += '$';
+                i++;
+            } else if (str[i + 1] == '$') {
+                literal += '$';
+                i += 2;
+            } else if (str[i + 1] == '{') {
+                size_t end = str.find('}', i + 2);
+                if (end == std::string::npos) {
+                    add_error(literal, "end of line while scanning for }");
+                    return;
+                } else if (end == i + 2) {
+                    add_error(literal, "empty variable name");
+                    return;
+                }
+                add_literal(literal);
+                add_var(str.substr(i + 2, end - i - 2));
+                i = end + 1;
+            } else if (IS_VAR_CHAR(str[i + 1])) {
+                size_t end = i + 2;
+                while (end < str.size() && IS_VAR_CHAR(str[end])) {
+                    end++;
+                }
+                add_literal(literal);
+                add_var(str.substr(i + 1, end - i - 1));
+                i = end;
+            } else {
+                add_error(literal, "empty variable name");
+                return;
+            }
+        }
+
+        if (! _segments.empty() || literal != _str) {
+            add_literal(literal);
+        }
+    }
+
+    /**
+     * Expand variables, returns a new string.
+     */
+    std::string VarTemplate::expand(const ShellEnv& env,
+                                    const std::string& shell) const
+    {
+        std::string buf;
+        return expand(env, shell, buf);
+    }
+
+    /**
+     * Expand variables into buf, returns buf or the source string if
+     * it is literal.
+     */
+    const std::string& VarTemplate::expand(const ShellEnv& env,
+                                           const std::string& shell,
+                                           std::string& buf) const
+    {
+        if (_segments.empty()) {
+            return _str;
+        }
+
+        // look up all values first, output is sized once and buf is
+        // left untouched if a variable is undefined
+        static thread_local std::vector<const std::string*> vals;
+        vals.clear();
+        size_t size = _literal_size;
+        for (auto& segment : _segments) {
+            if (segment.type == SEGMENT_LITERAL) {
+                continue;
+            } else if (segment.type == SEGMENT_ERROR) {
+                throw ScriptError(shell, segment.value);
+            }
+
+            const std::string* val = env.lookup_env(shell, segment.id);
+            if (val == nullptr) {
+                throw UndefinedException(shell, "variable", segment.value);
+            }
+            size += val->size();
+            vals.push_back(val);
+        }
+
+        buf.clear();
+        buf.reserve(size);
+        auto val = vals.begin();
+        for (auto& segment : _segments) {
+            if (segment.type == SEGMENT_LITERAL) {
+                buf += segment.value;
+            } else if (segment.type == SEGMENT_VAR_RE) {
+                buf += re_escape_val(**val++);
+            } else {
+                buf += **val++;
+            }
+        }
+        return buf;
+    }
+
+    /**
+     * Highest version of the variables referenced, unchanged as long
+     * as none of them are set.
+     */
+    uint64_t VarTemplate::version(const ShellEnv& env) const
+    {
+        uint64_t version = 0;
+        for (auto& segment : _segments) {
+            if (segment.type == SEGMENT_VAR
+                || segment.type == SEGMENT_VAR_RE) {
+                version = std::max(version, env.version(segment.id));
+            }
+        }
+        return version;
+    }
+
+    void VarTemplate::add_literal(std::string& literal)
+    {
+        if (! literal.empty()) {
+            _literal_size += literal.size();
+            _segments.push_back(Segment{SEGMENT_LITERAL, literal, 0});
+            literal.clear();
+        }
+    }
+
+    void VarTemplate::add_var(const std::string& var)
+    {
+        if (var[0] == '=') {
+            std::string name(var.substr(1));
+            var_id id = var_names().intern(name);
+            _segments.push_back(Segment{SEGMENT_VAR_RE, name, id});
+        } else {
+            _segments.push_back(Segment{SEGMENT_VAR, var,
+                                        var_names().intern(var)});
+        }
+    }
+
+    void VarTemplate::add_error(std::string& literal,
+                                const std::string& error)
+    {
+        add_literal(literal);
+        _segments.push_back(Segment{SEGMENT_ERROR, error, 0});
+    }
 }
@@ -17,7 +17,8 @@ namespace plux
         RES_CALL,
         RES_TIMEOUT,
         RES_INCLUDE,
-        RES_SET
+        RES_SET,
+        RES_PARALLEL
     };
 
     /**
@@ -66,6 +67,55 @@ namespace plux
     void append_var_val(const ShellEnv& env, const std::string& shell,
                         std::string& exp_str, const std::string& var);
 
+    /**
+     * String with variable references, compiled once into literal and
+     * variable segments. Expanding concatenates the segments, literal
+     * strings, without variables or $$, are used as is.
+     */
+    class VarTemplate {
+    public:
+        explicit VarTemplate(const std::string& str);
+
+        const std::string& str(void) const { return _str; }
+        bool is_literal(void) const { return _segments.empty(); }
+
+        std::string expand(const ShellEnv& env,
+                           const std::string& shell) const;
+        const std::string& expand(const ShellEnv& env,
+                                  const std::string& shell,
+                                  std::string& buf) const;
+        uint64_t version(const ShellEnv& env) const;
+
+    private:
+        enum segment_type {
+            SEGMENT_LITERAL,
+            SEGMENT_VAR,
+            /** ${=VAR}, value is escaped for use in a regex. */
+            SEGMENT_VAR_RE,
+            /** Invalid reference, error thrown when reached. */
+            SEGMENT_ERROR
+        };
+
+        struct Segment {
+            enum segment_type type;
+            /** Literal text, variable name or error message. */
+            std::string value;
+            /** Interned variable name, unused for other segments. */
+            var_id id;
+        };
+
+        void add_literal(std::string& literal);
+        void add_var(const std::string& var);
+        void add_error(std::string& literal, const std::string& error);
+
+        /** Source string. */
+        std::string _str;
+        /** Segments, empty if _str is literal. */
+        std::vector<Segment> _segments;
+        /** Size of all literal segments. */
+        size_t _literal_size;
+    };
+
     /**
      * Any line in headers or in shell or cleanup.
      */
@@ -82,10 +132,10 @@ namespace plux
 
         const std::string& file(void) const { return _file; }
         unsigned int line(void) const { return _line; }
-        const std::string& shell() const { return _shell; }
+        const std::string& shell() const { return _shell.str(); }
         std::string shell(ShellEnv& env, const std::string& shell) const
         {
-            return expand_var(env, shell, _shell);
+            return _shell.expand(env, shell);
         }
 
         virtual LineRes run(ShellCtx& ctx, ShellEnv& env) = 0;
@@ -102,7 +152,7 @@ namespace plux
         /** file line number. */
         unsigned int _line;
         /** shell line applies to, can be empty. */
-        std::string _shell;
+        VarTemplate _shell;
     };
 
     typedef std::vector<Line*> line_vector;
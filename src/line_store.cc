@@ -0,0 +1,125 @@
+#include "line_store.hh"
+
+namespace plux
+{
+    LineStore::LineStore(size_t history)
+        : _head(0),
+          _history(history),
+          _max_lines(0),
+          _max_bytes(0),
+          _bytes(0),
+          _dropped(0),
+          _dropped_bytes(0),
+          _keep(KEEP_NONE)
+    {
+    }
+
+    /**
+     * Set limits for lines not consumed, 0 for no limit. Applied as
+     * lines are added.
+     */
+    void LineStore::set_limits(size_t max_lines, size_t max_bytes)
+    {
+        _max_lines = max_lines;
+        _max_bytes = max_bytes;
+    }
+
+    /**
+     * Consume all lines before it, dropping consumed lines from the
+     * front once more than the history size is kept.
+     */
+    void LineStore::consume_until(iterator it)
+    {
+        size_t head = it - _lines.begin();
+        for (size_t i = _head; i < head; i++) {
+            _bytes -= _lines[i].size();
+        }
+        if (_keep != KEEP_NONE) {
+            _keep = _keep > head - _head ? _keep - (head - _head) : 0;
+        }
+        _head = head;
+        while (_head > _history) {
+            std::string& line = _lines.front();
+            if (_pool.size() < POOL_SIZE
+                && line.capacity() <= POOL_MAX_CAPACITY) {
+                _pool.push_back(std::move(line));
+                _pool.back().clear();
+            }
+            _lines.pop_front();
+            _head--;
+        }
+    }
+
+    void LineStore::clear(void)
+    {
+        _lines.clear();
+        _head = 0;
+        _bytes = 0;
+        _keep = KEEP_NONE;
+    }
+
+    /**
+     * Account for the line just added, dropping the oldest lines not
+     * consumed if over the limits.
+     */
+    void LineStore::pushed(void)
+    {
+        _bytes += _lines.back().size();
+
+        size_t num = 0;
+        size_t bytes = _bytes;
+        while (size() - num > 1 && num < _keep
+               && ((_max_lines && size() - num > _max_lines)
+                   || (_max_bytes && bytes > _max_bytes))) {
+            bytes -= _lines[_head + num].size();
+            num++;
+        }
+        if (num > 0) {
+            _dropped += num;
+            consume_until(begin() + num);
+        }
+    }
+
+    /**
+     * Bound buf, the incomplete line read after the lines, by the size
+     * limit. Once over the limit the oldest bytes are dropped leaving
+     * the last half of the limit, output without newlines is then
+     * only moved every half limit bytes.
+     *
+     * @return number of bytes dropped from the start of buf.
+     */
+    size_t LineStore::trim_partial(std::string& buf)
+    {
+        if (! _max_bytes || buf.size() <= _max_bytes) {
+            return 0;
+        }
+        size_t num = buf.size() - _max_bytes / 2;
+        buf.erase(0, num);
+        _dropped_bytes += num;
+        return num;
+    }
+
+    /**
+     * Get an empty buffer for the next line, reusing the buffer of a
+     * dropped line if available.
+     */
+    std::string LineStore::take_buffer(void)
+    {
+        if (_pool.empty()) {
+            return std::string();
+        }
+        std::string buf(std::move(_pool.back()));
+        _pool.pop_back();
+        return buf;
+    }
+
+    /**
+     * Get up to num of the last lines, including consumed lines still
+     * in the history.
+     */
+    std::vector<std::string> LineStore::tail(size_t num) const
+    {
+        size_t start = _lines.size() > num ? _lines.size() - num : 0;
+        return std::vector<std::string>(_lines.begin() + start, _lines.end());
+    }
+}
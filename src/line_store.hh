@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace plux
+{
+    /**
+     * Lines read from a shell, consumed from the front as matches
+     * complete. The most recently consumed lines are kept around for
+     * failure reports, buffers of lines dropped after that are pooled
+     * for reading the next lines into.
+     *
+     * Lines not consumed are limited by count and size, when a limit
+     * is exceeded the oldest lines are dropped as if consumed without
+     * a match. The newest line is never dropped and neither are lines
+     * from the one set with set_keep. The incomplete line being read
+     * is limited by size on its own, see trim_partial.
+     */
+    class LineStore {
+    public:
+        typedef std::deque<std::string> line_deque;
+        typedef line_deque::iterator iterator;
+
+        /** Number of consumed lines kept by default. */
+        static const size_t DEFAULT_HISTORY = 32;
+        /** set_keep value for dropping any line over the limits. */
+        static const size_t KEEP_NONE = SIZE_MAX;
+        /** Maximum number of pooled line buffers. */
+        static const size_t POOL_SIZE = 256;
+        /** Buffers with a larger capacity are freed, not pooled. */
+        static const size_t POOL_MAX_CAPACITY = 4096;
+
+        explicit LineStore(size_t history = DEFAULT_HISTORY);
+
+        void set_limits(size_t max_lines, size_t max_bytes);
+        /** Never drop lines from index keep on, relative to begin()
+         *  and moved along as lines are consumed. */
+        void set_keep(size_t keep) { _keep = keep; }
+        /** Number of lines dropped due to the limits. */
+        uint64_t dropped(void) const { return _dropped; }
+        /** Number of bytes dropped from incomplete lines. */
+        uint64_t dropped_bytes(void) const { return _dropped_bytes; }
+        /** Size of lines not consumed. */
+        size_t bytes(void) const { return _bytes; }
+
+        iterator begin(void) { return _lines.begin() + _head; }
+        iterator end(void) { return _lines.end(); }
+        size_t size(void) const { return _lines.size() - _head; }
+        bool empty(void) const { return size() == 0; }
+
+        std::string& back(void) { return _lines.back(); }
+        void push_back(const std::string& line) {
+            _lines.push_back(line);
+            pushed();
+        }
+        void push_back(std::string&& line) {
+            _lines.push_back(std::move(line));
+            pushed();
+        }
+
+        void consume_until(iterator it);
+        void clear(void);
+        size_t trim_partial(std::string& buf);
+
+        std::string take_buffer(void);
+        size_t pool_size(void) const { return _pool.size(); }
+
+        std::vector<std::string> tail(size_t num) const;
+
+    private:
+        void pushed(void);
+
+        /** Consumed lines kept as history followed by the lines. */
+        line_deque _lines;
+        /** Index of the first not consumed line. */
+        size_t _head;
+        /** Maximum number of consumed lines kept. */
+        size_t _history;
+        /** Empty buffers of dropped lines, capacity kept. */
+        std::vector<std::string> _pool;
+        /** Maximum number of lines not consumed, 0 for no limit. */
+        size_t _max_lines;
+        /** Maximum size of lines not consumed, 0 for no limit. */
+        size_t _max_bytes;
+        /** Size of lines not consumed. */
+        size_t _bytes;
+        /** Lines dropped due to the limits. */
+        uint64_t _dropped;
+        /** Bytes dropped from incomplete lines. */
+        uint64_t _dropped_bytes;
+        /** Index, relative to begin(), of the first line not to drop. */
+        size_t _keep;
+    };
+}
@@ -1,12 +1,17 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
 
+#include "os.hh"
 #include "plux.hh"
 #include "script_parse.hh"
 #include "script_run.hh"
+#include "timing_db.hh"
 
 extern "C" {
+#include <sys/wait.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <glob.h>
 #include <signal.h>
@@ -16,6 +21,13 @@ extern "C" {
 
 extern char **environ;
 
+/** Upper limit for -j, one worker process per job. */
+static const size_t MAX_JOBS = 1024;
+/** Upper limit for the number of shards in -s. */
+static const size_t MAX_SHARDS = 1024;
+/** Upper limit for -P, shells kept started per script. */
+static const unsigned long MAX_SHELL_POOL = 1024;
+
 static void signal_handler(int signal)
 {
     switch (signal) {
@@ -36,9 +48,13 @@ enum color {
     COLOR_BLUE
 };
 
+/** Set to true if stdout is a terminal, checked once as job output is
+    redirected to files. */
+static bool use_color = false;
+
 static std::string color(const std::string &str, enum color c)
 {
-    if (! isatty(STDOUT_FILENO)) {
+    if (! use_color) {
         return str;
     }
 
@@ -81,9 +97,31 @@ static int usage(const char* name)
 {
     std::cerr << "usage: " << name << " script" << std::endl;
     std::cerr << std::endl;
+    std::cerr << "    -B --max-bytes N keep at most N bytes of unmatched "
+              << "output per shell," << std::endl
+              << "                     an incomplete line over N bytes "
+              << "keeps its last N/2 bytes" << std::endl;
     std::cerr << "    -d --dump" << std::endl;
+    std::cerr << "    -D --timing-db PATH script duration database"
+              << std::endl;
     std::cerr << "    -h --help" << std::endl;
+    std::cerr << "    -j --jobs N     run N scripts in parallel, at most "
+              << MAX_JOBS << std::endl;
     std::cerr << "    -l --log-level" << std::endl;
+    std::cerr << "    -L --max-lines N keep at most N unmatched lines "
+              << "per shell" << std::endl;
+    std::cerr << "                     over -B or -L the oldest unmatched "
+              << "output is dropped," << std::endl
+              << "                     it is never matched but is kept in "
+              << "the shell log," << std::endl
+              << "                     a line matched by a pending match "
+              << "and later lines are kept" << std::endl;
+    std::cerr << "    -P --shell-pool N keep N shells started and at their "
+              << "prompt ahead of use," << std::endl
+              << "                      refilled while waiting for "
+              << "output, at most " << MAX_SHELL_POOL << std::endl;
+    std::cerr << "    -s --shard I/N  only run shard I of N scripts, N at "
+              << "most " << MAX_SHARDS << std::endl;
     std::cerr << "    -t --tail" << std::endl;
     std::cerr << "    -T --timeout MS set default timeout in milliseconds"
               << std::endl;
@@ -117,18 +155,20 @@ static int dump_script(plux::Script* script)
 }
 
 static int run_script(plux::Script* script, enum plux::log_level log_level,
-                      bool tail, size_t n, size_t tot)
+                      bool tail, size_t n, size_t tot,
+                      const std::string& log_dir)
 {
     struct timespec start;
     clock_gettime(CLOCK_MONOTONIC, &start);
 
     int exitcode = 1;
-    plux::LogFile log(log_level, "plux.log");
-    plux::FileProgressLog progress_log("plux.progress.log");
+    plux::LogFile log(log_level, plux::path_join(log_dir, "plux.log"));
+    plux::FileProgressLog progress_log(plux::path_join(log_dir,
+                                                       "plux.progress.log"));
 
     plux::env_map env;
     fill_os_env(env);
-    auto run = plux::ScriptRun(log, progress_log, env, script, tail);
+    plux::ScriptRun run(log, progress_log, env, script, tail);
     std::cout << plux::format_timestamp() << ": "
               << color(script->file(), COLOR_BLUE)
               << " (" << n << "/" << tot << ")" << std::endl;
@@ -161,7 +201,8 @@ static int run_script(plux::Script* script, enum plux::log_level log_level,
 }
 
 static int run_file(int opt_dump, enum plux::log_level opt_log_level,
-                    bool opt_tail, std::string file, size_t n, size_t tot)
+                    bool opt_tail, std::string file, size_t n, size_t tot,
+                    const std::string& log_dir)
 {
     int exitcode = 1;
 
@@ -181,7 +222,7 @@ static int run_file(int opt_dump, enum plux::log_level opt_log_level,
             exitcode = dump_script(script.get());
         } else {
             exitcode = run_script(script.get(), opt_log_level, opt_tail,
-                                  n, tot);
+                                  n, tot, log_dir);
         }
     } catch (plux::ScriptParseError& ex) {
         std::cerr << "parsing of " << ex.path() << " failed at line "
@@ -193,32 +234,192 @@ static int run_file(int opt_dump, enum plux::log_level opt_log_level,
     return exitcode;
 }
 
+static void print_summary(const std::vector<std::string>& err_files)
+{
+    if (err_files.empty()) {
+        std::cout << color("Success, all tests passed", COLOR_GREEN)
+                  << std::endl;
+    } else {
+        std::cout << color("Error:", COLOR_RED);
+        std::vector<std::string>::const_iterator eit(err_files.begin());
+        for (; eit != err_files.end(); ++eit) {
+            std::cout << " " << color(*eit, COLOR_YELLOW);
+        }
+        std::cout << std::endl;
+    }
+}
+
 static int run_files(int opt_dump, enum plux::log_level opt_log_level,
-                     bool opt_tail, std::vector<std::string>& files)
+                     bool opt_tail, std::vector<std::string>& files,
+                     plux::TimingDb& timing_db)
 {
     int exitcode = 0;
     std::vector<std::string> err_files;
     std::vector<std::string>::iterator it(files.begin());
     for (size_t n = 1; it != files.end(); n++, ++it) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
         int file_exitcode = run_file(opt_dump, opt_log_level, opt_tail, *it,
-                                     n, files.size());
+                                     n, files.size(), "");
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        timing_db.set(*it, plux::elapsed_ms(start, end));
         if (file_exitcode) {
             exitcode = exitcode ? exitcode : file_exitcode;
             err_files.push_back(*it);
         }
     }
 
-    if (err_files.empty()) {
-        std::cout << color("Success, all tests passed", COLOR_GREEN)
-                  << std::endl;
-    } else {
-        std::cout << color("Error:", COLOR_RED);
-        std::vector<std::string>::iterator eit(err_files.begin());
-        for (; eit != err_files.end(); ++eit) {
-            std::cout << " " << color(*eit, COLOR_YELLOW);
+    print_summary(err_files);
+    return exitcode;
+}
+
+/**
+ * Log directory for job number n, holds plux.log, plux.progress.log and
+ * the shell logs of the job.
+ */
+static std::string job_log_dir(size_t n)
+{
+    return plux::path_join(plux::default_log_dir(),
+                           "job-" + std::to_string(n));
+}
+
+/**
+ * Fork worker process running file, all output from the worker is
+ * written to plux.log in the job log directory.
+ *
+ * @return pid of worker process, -1 on failure.
+ */
+static pid_t start_job(int opt_dump, enum plux::log_level opt_log_level,
+                       bool opt_tail, const std::string& file,
+                       size_t n, size_t tot)
+{
+    std::string log_dir = job_log_dir(n);
+    if (! plux::os_ensure_dir(log_dir)) {
+        std::cerr << color("failed to create: ", COLOR_RED) << log_dir
+                  << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    std::string log_path = plux::path_join(log_dir, "plux.log");
+    int fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    if (fd == -1) {
+        std::cerr << color("failed to open: ", COLOR_RED) << log_path
+                  << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // flush before fork, avoid duplicated output from the worker
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+
+        plux::set_default_log_dir(log_dir);
+        int exitcode = run_file(opt_dump, opt_log_level, opt_tail, file,
+                                n, tot, log_dir);
+        std::cout.flush();
+        std::cerr.flush();
+        exit(exitcode);
+    }
+
+    close(fd);
+    if (pid == -1) {
+        std::cerr << color("failed to fork: ", COLOR_RED) << file
+                  << ": " << strerror(errno) << std::endl;
+    }
+    return pid;
+}
+
+/**
+ * Write output of finished job n to stdout.
+ */
+static void report_job(size_t n)
+{
+    std::string log_path = plux::path_join(job_log_dir(n), "plux.log");
+    std::ifstream is(log_path);
+    if (is.is_open()) {
+        std::cout << is.rdbuf();
+    }
+    std::cout.flush();
+}
+
+/**
+ * Run files in up to jobs worker processes at a time. Files are
+ * started longest expected duration first, each idle worker slot
+ * takes the next file from the shared queue. Output of the workers is
+ * reported in file order once a job, and all jobs before it, has
+ * completed.
+ */
+static int run_files_parallel(int opt_dump, enum plux::log_level opt_log_level,
+                              bool opt_tail, std::vector<std::string>& files,
+                              size_t jobs, plux::TimingDb& timing_db)
+{
+    std::vector<size_t> order =
+        plux::schedule_longest_first(files, timing_db);
+    // exit code of each file, -1 while not finished.
+    std::vector<int> exitcodes(files.size(), -1);
+    std::vector<struct timespec> starts(files.size());
+    std::map<pid_t, size_t> running;
+    size_t next = 0;
+    size_t reported = 0;
+    while (reported < files.size()) {
+        while (next < order.size() && running.size() < jobs) {
+            size_t i = order[next++];
+            clock_gettime(CLOCK_MONOTONIC, &starts[i]);
+            pid_t pid = start_job(opt_dump, opt_log_level, opt_tail,
+                                  files[i], i + 1, files.size());
+            if (pid == -1) {
+                exitcodes[i] = 1;
+            } else {
+                running[pid] = i;
+            }
+        }
+
+        if (! running.empty()) {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid == -1) {
+                if (errno != EINTR) {
+                    std::cerr << color("waitpid failed: ", COLOR_RED)
+                              << strerror(errno) << std::endl;
+                    return 1;
+                }
+                continue;
+            }
+
+            auto it = running.find(pid);
+            if (it == running.end()) {
+                continue;
+            }
+            struct timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            timing_db.set(files[it->second],
+                          plux::elapsed_ms(starts[it->second], end));
+            exitcodes[it->second] =
+                WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+            running.erase(it);
+        }
+
+        for (; reported < files.size() && exitcodes[reported] != -1;
+             reported++) {
+            report_job(reported + 1);
         }
-        std::cout << std::endl;
     }
+
+    int exitcode = 0;
+    std::vector<std::string> err_files;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (exitcodes[i]) {
+            exitcode = exitcode ? exitcode : exitcodes[i];
+            err_files.push_back(files[i]);
+        }
+    }
+
+    print_summary(err_files);
     return exitcode;
 }
 
@@ -240,14 +441,42 @@ static void find_plux_files(int argc, char** argv,
     }
 }
 
+/**
+ * Parse shard specification I/N, 1 <= I <= N.
+ */
+static bool parse_shard(const std::string& spec, size_t& shard,
+                        size_t& num_shards)
+{
+    size_t sep = spec.find('/');
+    if (sep == std::string::npos || spec.find('-') != std::string::npos) {
+        // stoul accepts and negates a leading minus.
+        return false;
+    }
+    try {
+        shard = std::stoul(spec.substr(0, sep));
+        num_shards = std::stoul(spec.substr(sep + 1));
+    } catch (std::invalid_argument &ex) {
+        return false;
+    } catch (std::out_of_range &ex) {
+        return false;
+    }
+    return shard >= 1 && shard <= num_shards && num_shards <= MAX_SHARDS;
+}
+
 int main(int argc, char *argv[])
 {
     const char* name = argv[0];
 
     struct option longopts[] = {
+        {"max-bytes", required_argument, nullptr, 'B'},
         {"dump", no_argument, nullptr, 'd'},
+        {"timing-db", required_argument, nullptr, 'D'},
         {"help", no_argument, nullptr, 'h'},
+        {"jobs", required_argument, nullptr, 'j'},
         {"log-level", required_argument, nullptr, 'l'},
+        {"max-lines", required_argument, nullptr, 'L'},
+        {"shell-pool", required_argument, nullptr, 'P'},
+        {"shard", required_argument, nullptr, 's'},
         {"tail", no_argument, nullptr, 't'},
         {"timeout", required_argument, nullptr, 'T'},
         {nullptr, no_argument, nullptr, '\0'}
@@ -255,23 +484,79 @@ int main(int argc, char *argv[])
 
     bool opt_dump = false;
     bool opt_tail = false;
+    size_t opt_jobs = 1;
+    size_t opt_shard = 0;
+    size_t opt_num_shards = 0;
+    std::string opt_timing_db;
     enum plux::log_level opt_log_level = plux::LOG_LEVEL_INFO;
 
     int ch;
-    while ((ch = getopt_long(argc, argv, "dhl:tT:", longopts, nullptr)) != -1) {
+    while ((ch = getopt_long(argc, argv, "B:dD:hj:l:L:P:s:tT:", longopts, nullptr)) != -1) {
         switch (ch) {
+        case 'B':
+            try {
+                plux::set_default_max_bytes(std::stoul(optarg));
+            } catch (std::invalid_argument &ex) {
+                return usage(name);
+            } catch (std::out_of_range &ex) {
+                return usage(name);
+            }
+            break;
         case 'd':
             opt_dump = true;
             break;
+        case 'D':
+            opt_timing_db = optarg;
+            break;
         case 'h':
             return usage(name);
             break;
+        case 'j':
+            try {
+                opt_jobs = std::stoul(optarg);
+            } catch (std::invalid_argument &ex) {
+                return usage(name);
+            } catch (std::out_of_range &ex) {
+                return usage(name);
+            }
+            if (opt_jobs == 0 || opt_jobs > MAX_JOBS) {
+                return usage(name);
+            }
+            break;
         case 'l':
             opt_log_level = plux::level_from_string(optarg);
             if (opt_log_level == plux::LOG_LEVEL_NO) {
                 return usage(name);
             }
             break;
+        case 'L':
+            try {
+                plux::set_default_max_lines(std::stoul(optarg));
+            } catch (std::invalid_argument &ex) {
+                return usage(name);
+            } catch (std::out_of_range &ex) {
+                return usage(name);
+            }
+            break;
+        case 'P':
+            try {
+                unsigned long size = std::stoul(optarg);
+                if (size > MAX_SHELL_POOL) {
+                    return usage(name);
+                }
+                plux::set_default_shell_pool_size(
+                    static_cast<unsigned int>(size));
+            } catch (std::invalid_argument &ex) {
+                return usage(name);
+            } catch (std::out_of_range &ex) {
+                return usage(name);
+            }
+            break;
+        case 's':
+            if (! parse_shard(optarg, opt_shard, opt_num_shards)) {
+                return usage(name);
+            }
+            break;
         case 't':
             opt_tail = true;
             break;
@@ -301,8 +586,35 @@ int main(int argc, char *argv[])
     sigaction(SIGINT, &act, 0);
     sigaction(SIGCHLD, &act, 0);
 
+    use_color = isatty(STDOUT_FILENO);
+
     std::vector<std::string> files;
     find_plux_files(argc, argv, files);
 
-    return run_files(opt_dump, opt_log_level, opt_tail, files);
+    plux::os_ensure_dir(plux::default_log_dir());
+    if (opt_timing_db.empty()) {
+        opt_timing_db = plux::path_join(plux::default_log_dir(), "timing.db");
+    }
+    plux::TimingDb timing_db(opt_timing_db);
+    timing_db.load();
+
+    if (opt_num_shards) {
+        files = plux::shard_files(files, timing_db, opt_shard,
+                                  opt_num_shards);
+    }
+
+    int exitcode;
+    if (opt_jobs > 1) {
+        exitcode = run_files_parallel(opt_dump, opt_log_level, opt_tail,
+                                      files, opt_jobs, timing_db);
+    } else {
+        exitcode = run_files(opt_dump, opt_log_level, opt_tail, files,
+                             timing_db);
+    }
+
+    if (! opt_dump && ! timing_db.save()) {
+        std::cerr << color("failed to save: ", COLOR_RED)
+                  << timing_db.path() << std::endl;
+    }
+    return exitcode;
 }
@@ -3,6 +3,7 @@
 extern "C" {
 #include <errno.h>
 #include <sys/stat.h>
+#include <unistd.h>
 }
 
 namespace plux
@@ -15,4 +16,75 @@ namespace plux
         }
         return true;
     }
+
+    /**
+     * Find command in path, the : separated directories searched
+     * by execvp with an empty entry being the current directory.
+     * Commands containing / are used as is. Returns false if command
+     * is not found, exec would then fail with ENOENT.
+     */
+    bool os_find_exec(const std::string& command, const std::string* path,
+                      std::string& exec_path)
+    {
+        if (command.empty()) {
+            return false;
+        }
+        if (command.find('/') != std::string::npos) {
+            exec_path = command;
+            return true;
+        }
+
+        std::string dirs(path ? *path : "/bin:/usr/bin");
+        size_t start = 0;
+        while (start <= dirs.size()) {
+            size_t end = dirs.find(':', start);
+            if (end == std::string::npos) {
+                end = dirs.size();
+            }
+            std::string file(dirs, start, end - start);
+            file += file.empty() ? "./" : "/";
+            file += command;
+
+            struct stat st;
+            if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)
+                && access(file.c_str(), X_OK) == 0) {
+                exec_path = file;
+                return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    /**
+     * Description of the errors exec can fail with, safe to use
+     * between fork and exec unlike strerror.
+     */
+    const char* os_exec_error(int err)
+    {
+        switch (err) {
+        case E2BIG:
+            return "Argument list too long";
+        case EACCES:
+            return "Permission denied";
+        case EINVAL:
+            return "Invalid argument";
+        case ELOOP:
+            return "Too many levels of symbolic links";
+        case ENAMETOOLONG:
+            return "File name too long";
+        case ENOENT:
+            return "No such file or directory";
+        case ENOEXEC:
+            return "Exec format error";
+        case ENOMEM:
+            return "Cannot allocate memory";
+        case ENOTDIR:
+            return "Not a directory";
+        case ETXTBSY:
+            return "Text file busy";
+        default:
+            return "exec failed";
+        }
+    }
 }
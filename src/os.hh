@@ -5,4 +5,7 @@
 namespace plux
 {
     bool os_ensure_dir(const std::string path, int mode=0750);
+    bool os_find_exec(const std::string& command, const std::string* path,
+                      std::string& exec_path);
+    const char* os_exec_error(int err);
 }
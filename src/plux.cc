@@ -69,6 +69,18 @@ namespace plux
         return buf.str();
     }
 
+    /**
+     * Difference between start and end in milliseconds.
+     */
+    uint64_t elapsed_ms(const struct timespec &start,
+                        const struct timespec &end)
+    {
+        int64_t nsec = end.tv_nsec - start.tv_nsec;
+        int64_t msec = (end.tv_sec - start.tv_sec) * 1000
+            + nsec / static_cast<int64_t>(NSEC_PER_MSEC);
+        return msec < 0 ? 0 : msec;
+    }
+
     /**
      * Get basename from path.
      */
@@ -123,6 +135,80 @@ namespace plux
         _default_timeout_ms = timeout_ms;
     }
 
+    static unsigned int _default_shell_pool_size = 0;
+
+    /**
+     * Return number of shells to start ahead of use, 0 if disabled.
+     */
+    unsigned int default_shell_pool_size()
+    {
+        return _default_shell_pool_size;
+    }
+
+    /**
+     * Set number of shells to start ahead of use.
+     */
+    void set_default_shell_pool_size(unsigned int size)
+    {
+        _default_shell_pool_size = size;
+    }
+
+    static size_t _default_max_lines = 0;
+    static size_t _default_max_bytes = 64 * 1024 * 1024;
+
+    /**
+     * Return maximum number of unmatched lines kept for each shell, 0
+     * if not limited.
+     */
+    size_t default_max_lines()
+    {
+        return _default_max_lines;
+    }
+
+    /**
+     * Set maximum number of unmatched lines kept for each shell.
+     */
+    void set_default_max_lines(size_t max_lines)
+    {
+        _default_max_lines = max_lines;
+    }
+
+    /**
+     * Return maximum size of unmatched lines kept for each shell, 0
+     * if not limited.
+     */
+    size_t default_max_bytes()
+    {
+        return _default_max_bytes;
+    }
+
+    /**
+     * Set maximum size of unmatched lines kept for each shell.
+     */
+    void set_default_max_bytes(size_t max_bytes)
+    {
+        _default_max_bytes = max_bytes;
+    }
+
+    static std::string _default_log_dir = "plux";
+
+    /**
+     * Return the directory shell logs are written to.
+     */
+    const std::string& default_log_dir()
+    {
+        return _default_log_dir;
+    }
+
+    /**
+     * Set directory shell logs are written to, used to separate logs
+     * of scripts running in parallel.
+     */
+    void set_default_log_dir(const std::string& log_dir)
+    {
+        _default_log_dir = log_dir;
+    }
+
     const std::string empty_string;
 
     const std::map<std::string, std::string> default_env = {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <ctime>
 #include <exception>
 #include <map>
@@ -89,6 +90,8 @@ namespace plux
     std::string format_timestamp(void);
     std::string format_elapsed(const struct timespec &start,
                                const struct timespec &end);
+    uint64_t elapsed_ms(const struct timespec &start,
+                        const struct timespec &end);
 
     std::string path_basename(const std::string& path);
     std::string path_dirname(const std::string& path);
@@ -108,6 +111,17 @@ namespace plux
     unsigned int default_timeout_ms();
     void set_default_timeout_ms(unsigned int timeout_ms);
 
+    unsigned int default_shell_pool_size();
+    void set_default_shell_pool_size(unsigned int size);
+
+    size_t default_max_lines();
+    void set_default_max_lines(size_t max_lines);
+    size_t default_max_bytes();
+    void set_default_max_bytes(size_t max_bytes);
+
+    const std::string& default_log_dir();
+    void set_default_log_dir(const std::string& log_dir);
+
     extern const std::string empty_string;
     extern const std::map<std::string, std::string> default_env;
 
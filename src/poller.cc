@@ -0,0 +1,242 @@
+#include "poller.hh"
+
+extern "C" {
+#include <errno.h>
+#include <unistd.h>
+}
+
+namespace plux
+{
+    const size_t ReadyPoller::MIN_READ_SIZE;
+    const size_t ReadyPoller::MAX_READ_SIZE;
+    const size_t ReadyPoller::READ_BUDGET;
+
+    /**
+     * Get input counters for file descriptor.
+     *
+     * @return nullptr if file descriptor is not added.
+     */
+    const PollerStats* Poller::stats(int fd) const
+    {
+        auto it = _stats.find(fd);
+        return it == _stats.end() ? nullptr : &it->second;
+    }
+
+    PollerStats* Poller::stats_find(int fd)
+    {
+        auto it = _stats.find(fd);
+        return it == _stats.end() ? nullptr : &it->second;
+    }
+
+    PollerStats& Poller::stats_add(int fd, size_t read_size)
+    {
+        PollerStats& stats = _stats[fd];
+        stats = PollerStats();
+        stats.read_size = read_size;
+        return stats;
+    }
+
+    void Poller::stats_remove(int fd)
+    {
+        _stats.erase(fd);
+    }
+
+    void Poller::stats_input(PollerStats& stats, ssize_t nread)
+    {
+        if (stats.last_wait != _num_waits) {
+            stats.last_wait = _num_waits;
+            stats.wakeups++;
+        }
+        if (nread > 0) {
+            stats.reads++;
+            stats.bytes += nread;
+        }
+    }
+
+    ReadyPoller::ReadyPoller(void)
+        : _ready_pos(0),
+          _ready_bytes(0),
+          _buf(new char[MAX_READ_SIZE])
+    {
+    }
+
+    bool ReadyPoller::next_input(PollerInput& input)
+    {
+        while (_ready_pos < _ready.size()) {
+            int fd = _ready[_ready_pos];
+            PollerStats* stats = stats_find(fd);
+            if (stats == nullptr) {
+                ready_next();
+                continue;
+            }
+
+            size_t read_size = stats->read_size;
+            ssize_t nread = read(fd, _buf.get(), read_size);
+            if (nread == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                ready_next();
+                continue;
+            }
+
+            stats_input(*stats, nread);
+            if (nread > 0) {
+                _ready_bytes += nread;
+                if (static_cast<size_t>(nread) == read_size) {
+                    if (read_size < MAX_READ_SIZE) {
+                        stats->read_size = read_size * 2;
+                    }
+                } else {
+                    if (static_cast<size_t>(nread) < read_size / 4
+                        && read_size > MIN_READ_SIZE) {
+                        stats->read_size = read_size / 2;
+                    }
+                    // short read, no more data available.
+                    ready_next();
+                }
+                if (_ready_bytes >= READ_BUDGET) {
+                    // left ready, read again in next wait.
+                    ready_next();
+                }
+            } else {
+                ready_next();
+            }
+
+            input.fd = fd;
+            input.data = _buf.get();
+            input.size = nread;
+            input.error = nread == -1 ? errno : 0;
+            return true;
+        }
+        return false;
+    }
+
+    void ReadyPoller::ready_clear(void)
+    {
+        _num_waits++;
+        _ready.clear();
+        _ready_pos = 0;
+        _ready_bytes = 0;
+    }
+
+    void ReadyPoller::ready_add(int fd)
+    {
+        _ready.push_back(fd);
+    }
+
+    void ReadyPoller::ready_next(void)
+    {
+        _ready_pos++;
+        _ready_bytes = 0;
+    }
+
+    bool PollPoller::add(int fd)
+    {
+        stats_add(fd, MIN_READ_SIZE);
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        _fds.push_back(pfd);
+        return true;
+    }
+
+    void PollPoller::remove(int fd)
+    {
+        auto it = _fds.begin();
+        for (; it != _fds.end(); ++it) {
+            if (it->fd == fd) {
+                _fds.erase(it);
+                stats_remove(fd);
+                return;
+            }
+        }
+    }
+
+    int PollPoller::wait(int timeout_ms)
+    {
+        ready_clear();
+        int ret = poll(_fds.data(), _fds.size(), timeout_ms);
+        if (ret > 0) {
+            for (auto& pfd : _fds) {
+                if (pfd.revents & POLLIN) {
+                    ready_add(pfd.fd);
+                }
+            }
+        }
+        return ret;
+    }
+
+#ifdef HAVE_SYS_EPOLL_H
+    EpollPoller::EpollPoller(int epfd)
+        : _epfd(epfd),
+          _num_fds(0)
+    {
+    }
+
+    EpollPoller::~EpollPoller(void)
+    {
+        close(_epfd);
+    }
+
+    bool EpollPoller::add(int fd)
+    {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            return false;
+        }
+        stats_add(fd, MIN_READ_SIZE);
+        _num_fds++;
+        return true;
+    }
+
+    void EpollPoller::remove(int fd)
+    {
+        if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr) == 0) {
+            _num_fds--;
+        }
+        stats_remove(fd);
+    }
+
+    int EpollPoller::wait(int timeout_ms)
+    {
+        ready_clear();
+        if (_events.size() < _num_fds || _events.empty()) {
+            _events.resize(_num_fds ? _num_fds : 1);
+        }
+
+        int ret = epoll_wait(_epfd, _events.data(), _events.size(),
+                             timeout_ms);
+        for (int i = 0; i < ret; i++) {
+            // hang-up without input is reported as ready, in line
+            // with poll, but not added to ready.
+            if (_events[i].events & EPOLLIN) {
+                ready_add(_events[i].data.fd);
+            }
+        }
+        return ret;
+    }
+#endif // HAVE_SYS_EPOLL_H
+
+    /**
+     * Create Poller, io_uring or epoll if available falling back to
+     * poll.
+     */
+    Poller* mk_poller(void)
+    {
+#ifdef HAVE_IO_URING
+        IoUringPoller* io_uring_poller = new IoUringPoller();
+        if (io_uring_poller->init()) {
+            return io_uring_poller;
+        }
+        delete io_uring_poller;
+#endif // HAVE_IO_URING
+#ifdef HAVE_SYS_EPOLL_H
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd != -1) {
+            return new EpollPoller(epfd);
+        }
+#endif // HAVE_SYS_EPOLL_H
+        return new PollPoller();
+    }
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+
+extern "C" {
+#include <poll.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif // HAVE_SYS_EPOLL_H
+}
+
+namespace plux
+{
+    /**
+     * Input read from file descriptor.
+     */
+    class PollerInput {
+    public:
+        PollerInput(void)
+            : fd(-1),
+              data(nullptr),
+              size(0),
+              error(0)
+        {
+        }
+
+        /** File descriptor input was read from. */
+        int fd;
+        /** Data, valid until next call to the Poller. */
+        const char* data;
+        /** Number of bytes read, 0 on end of file and -1 on error. */
+        ssize_t size;
+        /** errno if size is -1. */
+        int error;
+    };
+
+    /**
+     * Input counters for file descriptor.
+     */
+    class PollerStats {
+    public:
+        PollerStats(void)
+            : wakeups(0),
+              reads(0),
+              bytes(0),
+              read_size(0),
+              last_wait(0)
+        {
+        }
+
+        /** Number of waits with input from the file descriptor. */
+        uint64_t wakeups;
+        /** Number of reads returning data. */
+        uint64_t reads;
+        /** Number of bytes read. */
+        uint64_t bytes;
+        /** Current read size. */
+        size_t read_size;
+        /** Wait the last wakeup was counted in. */
+        uint64_t last_wait;
+    };
+
+    /**
+     * Persistent set of file descriptors waited on for input.
+     *
+     * File descriptors are added once when a shell is started and
+     * removed when it is gone, input is only read from descriptors
+     * that are ready.
+     */
+    class Poller {
+    public:
+        virtual ~Poller(void) { }
+
+        virtual const char* name(void) const = 0;
+
+        virtual bool add(int fd) = 0;
+        virtual void remove(int fd) = 0;
+        /**
+         * Wait for input on added file descriptors.
+         *
+         * @return > 0 if input is available, 0 on timeout and -1
+         *         on error with errno set.
+         */
+        virtual int wait(int timeout_ms) = 0;
+        /**
+         * Get next input after wait.
+         *
+         * @return false if no more input is available.
+         */
+        virtual bool next_input(PollerInput& input) = 0;
+
+        const PollerStats* stats(int fd) const;
+
+    protected:
+        Poller(void)
+            : _num_waits(0)
+        {
+        }
+
+        PollerStats* stats_find(int fd);
+        PollerStats& stats_add(int fd, size_t read_size);
+        void stats_remove(int fd);
+        void stats_input(PollerStats& stats, ssize_t nread);
+
+    protected:
+        /** Number of calls to wait. */
+        uint64_t _num_waits;
+
+    private:
+        /** Counters for added file descriptors. */
+        std::unordered_map<int, PollerStats> _stats;
+    };
+
+    /**
+     * Base for pollers reporting file descriptors ready for reading,
+     * input is read with read(2) in next_input.
+     *
+     * Ready file descriptors are drained until EAGAIN, or a short
+     * read, up to READ_BUDGET bytes per wait to not starve other
+     * file descriptors. The read size of each file descriptor adapts
+     * to the amount of data available, between MIN_READ_SIZE and
+     * MAX_READ_SIZE.
+     */
+    class ReadyPoller : public Poller {
+    public:
+        static const size_t MIN_READ_SIZE = 4096;
+        static const size_t MAX_READ_SIZE = 65536;
+        static const size_t READ_BUDGET = 262144;
+
+        ReadyPoller(void);
+        virtual ~ReadyPoller(void) { }
+
+        virtual bool next_input(PollerInput& input) override;
+
+    protected:
+        void ready_clear(void);
+        void ready_add(int fd);
+
+    private:
+        void ready_next(void);
+
+    private:
+        /** File descriptors ready for reading, filled in by wait. */
+        std::vector<int> _ready;
+        /** Position of file descriptor being read in _ready. */
+        size_t _ready_pos;
+        /** Bytes read from current file descriptor in this wait. */
+        size_t _ready_bytes;
+        /** Buffer input is read into, MAX_READ_SIZE bytes. */
+        std::unique_ptr<char[]> _buf;
+    };
+
+    /**
+     * poll(2) based Poller, the pollfd array is only updated when
+     * file descriptors are added or removed.
+     */
+    class PollPoller : public ReadyPoller {
+    public:
+        PollPoller(void) { }
+        virtual ~PollPoller(void) { }
+
+        virtual const char* name(void) const override { return "poll"; }
+
+        virtual bool add(int fd) override;
+        virtual void remove(int fd) override;
+        virtual int wait(int timeout_ms) override;
+
+    private:
+        std::vector<struct pollfd> _fds;
+    };
+
+#ifdef HAVE_SYS_EPOLL_H
+    /**
+     * epoll(7) based Poller, wakeups only touch ready descriptors.
+     */
+    class EpollPoller : public ReadyPoller {
+    public:
+        explicit EpollPoller(int epfd);
+        EpollPoller(const EpollPoller& poller) = delete;
+        virtual ~EpollPoller(void);
+
+        virtual const char* name(void) const override { return "epoll"; }
+
+        virtual bool add(int fd) override;
+        virtual void remove(int fd) override;
+        virtual int wait(int timeout_ms) override;
+
+    private:
+        /** epoll instance. */
+        int _epfd;
+        /** Number of added descriptors, sizes the event array. */
+        size_t _num_fds;
+        /** Events filled in by epoll_wait. */
+        std::vector<struct epoll_event> _events;
+    };
+#endif // HAVE_SYS_EPOLL_H
+
+#ifdef HAVE_IO_URING
+    class IoUring;
+
+    /**
+     * io_uring(7) based Poller, reads are kept posted on all file
+     * descriptors using buffers from a ring registered with the
+     * kernel. Completed reads are collected and new reads are
+     * submitted with a single system call per wait.
+     *
+     * Multishot reads are used if supported by the kernel, else
+     * reads are posted again after each completion.
+     */
+    class IoUringPoller : public Poller {
+    public:
+        IoUringPoller(void);
+        IoUringPoller(const IoUringPoller& poller) = delete;
+        virtual ~IoUringPoller(void);
+
+        bool init(void);
+
+        virtual const char* name(void) const override { return "io_uring"; }
+
+        virtual bool add(int fd) override;
+        virtual void remove(int fd) override;
+        virtual int wait(int timeout_ms) override;
+        virtual bool next_input(PollerInput& input) override;
+
+        bool is_multishot(void) const { return _multishot; }
+
+    private:
+        /** State of read posted on file descriptor. */
+        class ReadState {
+        public:
+            ReadState(void)
+                : user_data(0),
+                  is_posted(false),
+                  is_eof(false)
+            {
+            }
+
+            /** Identifies completions, unique for every add. */
+            uint64_t user_data;
+            /** true while the read is active in the kernel. */
+            bool is_posted;
+            /** true after end of file or error, read not posted. */
+            bool is_eof;
+        };
+
+        void post_read(int fd, ReadState& state);
+        void recycle_buf(void);
+
+    private:
+        std::unique_ptr<IoUring> _ring;
+        /** Read state for added file descriptors. */
+        std::unordered_map<int, ReadState> _reads;
+        /** Generation counter for user_data. */
+        uint64_t _generation;
+        /** If true, kernel supports multishot reads. */
+        bool _multishot;
+        /** Buffer id handed out in last input, -1 if none. */
+        int _input_bid;
+    };
+#endif // HAVE_IO_URING
+
+    Poller* mk_poller(void);
+}
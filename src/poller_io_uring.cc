@@ -0,0 +1,519 @@
+#include "poller.hh"
+
+#ifdef HAVE_IO_URING
+
+#include <cstring>
+
+extern "C" {
+#include <linux/io_uring.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+namespace plux
+{
+    /** IORING_OP_READ_MULTISHOT, Linux 6.7, missing in older headers. */
+    static const uint8_t OP_READ_MULTISHOT = 49;
+    /** Number of submission queue entries. */
+    static const unsigned RING_ENTRIES = 64;
+    /** Number of read buffers, must be a power of 2. */
+    static const unsigned NUM_BUFS = 64;
+    /** Size of read buffer. */
+    static const unsigned BUF_SIZE = 4096;
+    /** Buffer group id used for all reads. */
+    static const uint16_t BUF_GROUP = 0;
+
+    /**
+     * Minimal io_uring instance using raw system calls, with a
+     * provided buffer ring registered with the kernel.
+     */
+    class IoUring {
+    public:
+        IoUring(void);
+        IoUring(const IoUring& ring) = delete;
+        ~IoUring(void);
+
+        bool setup(unsigned entries);
+        bool probe_op(uint8_t op);
+        bool register_bufs(void);
+
+        struct io_uring_sqe* get_sqe(void);
+        int submit(void);
+        int wait(int timeout_ms);
+
+        bool has_cqe(void) const;
+        struct io_uring_cqe* peek_cqe(void);
+        void cqe_seen(void);
+
+        const char* buf(int bid) const { return _bufs + bid * BUF_SIZE; }
+        void recycle_buf(int bid);
+
+    private:
+        void flush_sq(void);
+
+    private:
+        int _fd;
+
+        void* _ring;
+        size_t _ring_size;
+        struct io_uring_sqe* _sqes;
+        size_t _sqes_size;
+
+        unsigned* _sq_head;
+        unsigned* _sq_tail;
+        unsigned* _sq_array;
+        unsigned _sq_mask;
+        unsigned _sq_entries;
+        /** Tail including entries not yet made visible to the kernel. */
+        unsigned _sq_local_tail;
+        /** Number of entries visible to the kernel, not submitted. */
+        unsigned _to_submit;
+
+        unsigned* _cq_head;
+        unsigned* _cq_tail;
+        unsigned _cq_mask;
+        struct io_uring_cqe* _cqes;
+
+        /** Provided buffer ring, struct io_uring_buf entries. */
+        struct io_uring_buf* _buf_ring;
+        /** Tail of buffer ring, overlays resv of first entry. */
+        uint16_t* _buf_ring_tail;
+        uint16_t _buf_local_tail;
+        /** Buffer memory, NUM_BUFS of BUF_SIZE bytes. */
+        char* _bufs;
+    };
+
+    IoUring::IoUring(void)
+        : _fd(-1),
+          _ring(MAP_FAILED),
+          _ring_size(0),
+          _sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+          _sqes_size(0),
+          _sq_local_tail(0),
+          _to_submit(0),
+          _buf_ring(static_cast<struct io_uring_buf*>(MAP_FAILED)),
+          _buf_ring_tail(nullptr),
+          _buf_local_tail(0),
+          _bufs(static_cast<char*>(MAP_FAILED))
+    {
+    }
+
+    IoUring::~IoUring(void)
+    {
+        // closing the ring cancels all posted reads, buffers are
+        // released after.
+        if (_fd != -1) {
+            close(_fd);
+        }
+        if (_sqes != MAP_FAILED) {
+            munmap(_sqes, _sqes_size);
+        }
+        if (_ring != MAP_FAILED) {
+            munmap(_ring, _ring_size);
+        }
+        if (_buf_ring != MAP_FAILED) {
+            munmap(_buf_ring, NUM_BUFS * sizeof(struct io_uring_buf));
+        }
+        if (_bufs != MAP_FAILED) {
+            munmap(_bufs, NUM_BUFS * BUF_SIZE);
+        }
+    }
+
+    bool IoUring::setup(unsigned entries)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        _fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (_fd == -1) {
+            return false;
+        }
+        if (! (params.features & IORING_FEAT_SINGLE_MMAP)
+            || ! (params.features & IORING_FEAT_EXT_ARG)) {
+            return false;
+        }
+
+        size_t sq_size = params.sq_off.array
+            + params.sq_entries * sizeof(unsigned);
+        size_t cq_size = params.cq_off.cqes
+            + params.cq_entries * sizeof(struct io_uring_cqe);
+        _ring_size = sq_size > cq_size ? sq_size : cq_size;
+        _ring = mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+        if (_ring == MAP_FAILED) {
+            return false;
+        }
+
+        _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = static_cast<struct io_uring_sqe*>(
+            mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+        if (_sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* ring = static_cast<char*>(_ring);
+        _sq_head = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        _sq_tail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        _sq_array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        _sq_mask = *reinterpret_cast<unsigned*>(ring
+                                                + params.sq_off.ring_mask);
+        _sq_entries = params.sq_entries;
+        _sq_local_tail = *_sq_tail;
+
+        _cq_head = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        _cq_tail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        _cq_mask = *reinterpret_cast<unsigned*>(ring
+                                                + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<struct io_uring_cqe*>(ring
+                                                       + params.cq_off.cqes);
+        return true;
+    }
+
+    /**
+     * Check if operation is supported by the running kernel.
+     */
+    bool IoUring::probe_op(uint8_t op)
+    {
+        size_t size = sizeof(struct io_uring_probe)
+            + 256 * sizeof(struct io_uring_probe_op);
+        std::unique_ptr<char[]> buf(new char[size]);
+        memset(buf.get(), 0, size);
+
+        auto probe = reinterpret_cast<struct io_uring_probe*>(buf.get());
+        if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE,
+                    probe, 256) == -1) {
+            return false;
+        }
+        if (op > probe->last_op) {
+            return false;
+        }
+        auto ops = reinterpret_cast<struct io_uring_probe_op*>(
+            buf.get() + sizeof(struct io_uring_probe));
+        return ops[op].flags & IO_URING_OP_SUPPORTED;
+    }
+
+    /**
+     * Register ring with NUM_BUFS buffers used by all reads.
+     */
+    bool IoUring::register_bufs(void)
+    {
+        _buf_ring = static_cast<struct io_uring_buf*>(
+            mmap(nullptr, NUM_BUFS * sizeof(struct io_uring_buf),
+                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (_buf_ring == MAP_FAILED) {
+            return false;
+        }
+        _bufs = static_cast<char*>(
+            mmap(nullptr, NUM_BUFS * BUF_SIZE,
+                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (_bufs == MAP_FAILED) {
+            return false;
+        }
+
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(_buf_ring);
+        reg.ring_entries = NUM_BUFS;
+        reg.bgid = BUF_GROUP;
+        if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING,
+                    &reg, 1) == -1) {
+            return false;
+        }
+
+        _buf_ring_tail = &_buf_ring[0].resv;
+        for (unsigned bid = 0; bid < NUM_BUFS; bid++) {
+            recycle_buf(bid);
+        }
+        return true;
+    }
+
+    struct io_uring_sqe* IoUring::get_sqe(void)
+    {
+        unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (_sq_local_tail - head >= _sq_entries) {
+            submit();
+            head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+            if (_sq_local_tail - head >= _sq_entries) {
+                return nullptr;
+            }
+        }
+
+        unsigned idx = _sq_local_tail & _sq_mask;
+        struct io_uring_sqe* sqe = &_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        _sq_array[idx] = idx;
+        _sq_local_tail++;
+        _to_submit++;
+        return sqe;
+    }
+
+    void IoUring::flush_sq(void)
+    {
+        __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Submit queued entries without waiting.
+     */
+    int IoUring::submit(void)
+    {
+        flush_sq();
+        while (_to_submit > 0) {
+            int ret = syscall(__NR_io_uring_enter, _fd, _to_submit, 0, 0,
+                              nullptr, 0);
+            if (ret == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            _to_submit -= ret;
+        }
+        return 0;
+    }
+
+    /**
+     * Submit queued entries and wait for at least one completion.
+     *
+     * @return 1 if completions are available, 0 on timeout and -1 on
+     *         error with errno set.
+     */
+    int IoUring::wait(int timeout_ms)
+    {
+        // submit separately, io_uring_enter hides errors from the
+        // wait, such as timeout, if entries were submitted.
+        if (submit() == -1) {
+            return -1;
+        }
+
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+
+        int ret = syscall(__NR_io_uring_enter, _fd, 0, 1,
+                          IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                          &arg, sizeof(arg));
+        if (ret == -1) {
+            if (errno == ETIME) {
+                return has_cqe() ? 1 : 0;
+            }
+            return -1;
+        }
+        return has_cqe() ? 1 : 0;
+    }
+
+    bool IoUring::has_cqe(void) const
+    {
+        return *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    struct io_uring_cqe* IoUring::peek_cqe(void)
+    {
+        if (! has_cqe()) {
+            return nullptr;
+        }
+        return &_cqes[*_cq_head & _cq_mask];
+    }
+
+    void IoUring::cqe_seen(void)
+    {
+        __atomic_store_n(_cq_head, *_cq_head + 1, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Give buffer back to the kernel.
+     */
+    void IoUring::recycle_buf(int bid)
+    {
+        // only set addr, len and bid, resv of the first entry is the
+        // ring tail.
+        struct io_uring_buf* buf = &_buf_ring[_buf_local_tail
+                                              & (NUM_BUFS - 1)];
+        buf->addr = reinterpret_cast<uint64_t>(_bufs + bid * BUF_SIZE);
+        buf->len = BUF_SIZE;
+        buf->bid = bid;
+        _buf_local_tail++;
+        __atomic_store_n(_buf_ring_tail, _buf_local_tail, __ATOMIC_RELEASE);
+    }
+
+    IoUringPoller::IoUringPoller(void)
+        : _ring(new IoUring()),
+          _generation(0),
+          _multishot(false),
+          _input_bid(-1)
+    {
+    }
+
+    IoUringPoller::~IoUringPoller(void)
+    {
+    }
+
+    /**
+     * Setup ring and buffers.
+     *
+     * @return false if io_uring is not usable, such as when the
+     *         kernel is too old or io_uring is disabled.
+     */
+    bool IoUringPoller::init(void)
+    {
+        if (! _ring->setup(RING_ENTRIES) || ! _ring->register_bufs()) {
+            return false;
+        }
+        _multishot = _ring->probe_op(OP_READ_MULTISHOT);
+        return true;
+    }
+
+    bool IoUringPoller::add(int fd)
+    {
+        ReadState& state = _reads[fd];
+        state = ReadState();
+        state.user_data = (++_generation << 32)
+            | static_cast<uint32_t>(fd);
+        stats_add(fd, BUF_SIZE);
+        post_read(fd, state);
+        return true;
+    }
+
+    void IoUringPoller::remove(int fd)
+    {
+        auto it = _reads.find(fd);
+        if (it == _reads.end()) {
+            return;
+        }
+
+        if (it->second.is_posted) {
+            struct io_uring_sqe* sqe = _ring->get_sqe();
+            if (sqe != nullptr) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = it->second.user_data;
+                // user_data 0 is never used for reads, completion is
+                // ignored.
+                sqe->user_data = 0;
+            }
+        }
+        _reads.erase(it);
+        stats_remove(fd);
+    }
+
+    int IoUringPoller::wait(int timeout_ms)
+    {
+        _num_waits++;
+        recycle_buf();
+        for (auto& it : _reads) {
+            if (! it.second.is_posted && ! it.second.is_eof) {
+                post_read(it.first, it.second);
+            }
+        }
+
+        if (_ring->has_cqe()) {
+            return _ring->submit() == -1 ? -1 : 1;
+        }
+        return _ring->wait(timeout_ms);
+    }
+
+    bool IoUringPoller::next_input(PollerInput& input)
+    {
+        recycle_buf();
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = _ring->peek_cqe()) != nullptr) {
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            _ring->cqe_seen();
+
+            int bid = -1;
+            if (flags & IORING_CQE_F_BUFFER) {
+                bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            }
+
+            // completion from a removed, or re-added, file descriptor.
+            int fd = static_cast<int>(user_data & 0xffffffff);
+            auto it = _reads.find(fd);
+            if (user_data == 0 || it == _reads.end()
+                || it->second.user_data != user_data) {
+                if (bid != -1) {
+                    _ring->recycle_buf(bid);
+                }
+                continue;
+            }
+
+            ReadState& state = it->second;
+            if (! (flags & IORING_CQE_F_MORE)) {
+                state.is_posted = false;
+            }
+            if (res == -ENOBUFS) {
+                // out of buffers, read is posted again in wait once
+                // buffers have been given back.
+                continue;
+            }
+
+            PollerStats* stats = stats_find(fd);
+            if (stats != nullptr) {
+                stats_input(*stats, res > 0 ? res : 0);
+            }
+
+            input.fd = fd;
+            if (res > 0) {
+                input.data = _ring->buf(bid);
+                input.size = res;
+                input.error = 0;
+                _input_bid = bid;
+            } else {
+                if (bid != -1) {
+                    _ring->recycle_buf(bid);
+                }
+                input.data = nullptr;
+                input.size = res == 0 ? 0 : -1;
+                input.error = res == 0 ? 0 : -res;
+                state.is_eof = true;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void IoUringPoller::post_read(int fd, ReadState& state)
+    {
+        struct io_uring_sqe* sqe = _ring->get_sqe();
+        if (sqe == nullptr) {
+            return;
+        }
+
+        if (_multishot) {
+            sqe->opcode = OP_READ_MULTISHOT;
+            sqe->len = 0;
+        } else {
+            sqe->opcode = IORING_OP_READ;
+            sqe->len = BUF_SIZE;
+        }
+        sqe->fd = fd;
+        sqe->off = static_cast<uint64_t>(-1);
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+        sqe->user_data = state.user_data;
+        state.is_posted = true;
+    }
+
+    /**
+     * Give buffer of last input back to the kernel, the input has
+     * been handled when the Poller is called again.
+     */
+    void IoUringPoller::recycle_buf(void)
+    {
+        if (_input_bid != -1) {
+            _ring->recycle_buf(_input_bid);
+            _input_bid = -1;
+        }
+    }
+}
+
+#endif // HAVE_IO_URING
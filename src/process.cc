@@ -1,3 +1,4 @@
+#include "os.hh"
 #include "process.hh"
 #include "util.hh"
 
@@ -5,7 +6,9 @@
 #include <memory>
 
 extern "C" {
+#include <errno.h>
 #include <fcntl.h>
+#include <spawn.h>
 #include <unistd.h>
 }
 
@@ -25,6 +28,33 @@ static void _close_pipe(int *fds)
     }
 }
 
+/**
+ * Connect stdin and stdout/stderr of the spawned process to the
+ * pipes, the pipe fds themselves are not kept open in the child.
+ */
+static int _add_pipe_actions(posix_spawn_file_actions_t* actions,
+                             int *stdin_pipe, int *stdout_pipe)
+{
+    int err;
+    if ((err = posix_spawn_file_actions_adddup2(actions, stdin_pipe[0],
+                                                STDIN_FILENO))
+        || (err = posix_spawn_file_actions_adddup2(actions, stdout_pipe[1],
+                                                   STDOUT_FILENO))
+        || (err = posix_spawn_file_actions_adddup2(actions, stdout_pipe[1],
+                                                   STDERR_FILENO))) {
+        return err;
+    }
+
+    int fds[] = {stdin_pipe[0], stdin_pipe[1], stdout_pipe[0], stdout_pipe[1]};
+    for (auto fd : fds) {
+        if (fd > STDERR_FILENO
+            && (err = posix_spawn_file_actions_addclose(actions, fd))) {
+            return err;
+        }
+    }
+    return 0;
+}
+
 plux::Process::Process(Log& log,
                        ShellLog* shell_log,
                        ProgressLog& progress_log,
@@ -43,33 +73,48 @@ plux::Process::Process(Log& log,
         log_and_throw_strerror("pipe");
     }
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        log_and_throw_strerror("fork");
+    std::string path;
+    bool found = os_find_exec(args[0], _shell_env.os_get("PATH"), path);
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 1);
+    for (auto &arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
     }
-    set_pid(pid);
-
-
-    if (pid == 0) {
-        cleanup.cancel();
+    argv.push_back(nullptr);
 
-        // child
-        dup2(_stdin_pipe[0], STDIN_FILENO);
-        dup2(_stdout_pipe[1], STDOUT_FILENO);
-        dup2(_stdout_pipe[1], STDERR_FILENO);
+    posix_spawn_file_actions_t actions;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err) {
+        errno = err;
+        log_and_throw_strerror("posix_spawn_file_actions_init");
+    }
+    Defer destroy([&actions] {
+        posix_spawn_file_actions_destroy(&actions);
+    });
+    if ((err = _add_pipe_actions(&actions, _stdin_pipe, _stdout_pipe))) {
+        errno = err;
+        log_and_throw_strerror("posix_spawn_file_actions");
+    }
 
-        _shell_env.set_os_env();
-        char **argv = new char*[args.size() + 1];
-        int i = 0;
-        for (auto &arg : args) {
-            argv[i++] = const_cast<char*>(arg.c_str());
-        }
-        argv[i] = nullptr;
-        execvp(argv[0], argv);
-        _log << "Process" << "failed to exec " << argv[0] << ": "
-             << strerror(errno) << LOG_LEVEL_ERROR;
-        delete [] argv;
-        exit(127);
+    pid_t pid;
+    if (! found) {
+        err = ENOENT;
+    } else {
+        err = posix_spawn(&pid, path.c_str(), &actions, nullptr,
+                          argv.data(), _shell_env.os_envp());
+    }
+    if (err == ENOEXEC) {
+        // run as a shell script if not an executable, as execvp does
+        std::vector<char*> sh_argv(argv);
+        sh_argv[0] = const_cast<char*>(path.c_str());
+        sh_argv.insert(sh_argv.begin(), const_cast<char*>("/bin/sh"));
+        err = posix_spawn(&pid, sh_argv[0], &actions, nullptr,
+                          sh_argv.data(), _shell_env.os_envp());
+    }
+    if (err) {
+        spawn_failed(args[0], err);
+    } else {
+        set_pid(pid);
     }
 
     int flags = fcntl(fd_input(), F_GETFL, 0);
@@ -83,6 +128,20 @@ plux::Process::Process(Log& log,
     cleanup.cancel();
 }
 
+/**
+ * Report failure to spawn process the way a failed exec in the
+ * child would, on the output followed by exit status 127.
+ */
+void plux::Process::spawn_failed(const std::string& command, int err)
+{
+    _log << "Process" << "failed to exec " << command << ": "
+         << strerror(err) << LOG_LEVEL_ERROR;
+    std::string msg("Process: failed to exec " + command + ": "
+                    + strerror(err) + "\n");
+    write(_stdout_pipe[1], msg.c_str(), msg.size());
+    set_alive(false, 127);
+}
+
 plux::Process::~Process()
 {
     cleanup();
@@ -6,7 +6,7 @@ namespace plux
 {
     /**
      * Process control, used to run processes without any shell/terminal
-     * in-between.
+     * in-between. Processes are started with posix_spawn.
      */
     class Process : public ProcessBase {
     public:
@@ -26,6 +26,7 @@ namespace plux
         void stop() override;
 
      private:
+        void spawn_failed(const std::string& command, int err);
         void cleanup();
 
         int _stdin_pipe[2];
@@ -42,9 +42,14 @@ plux::ProcessBase::ProcessBase(Log& log,
       _timeout_ms(plux::default_timeout_ms()),
       _command(command),
       _trim_special(trim_special),
+      _error_is_literal(false),
+      _line_cursor(0),
+      _line_matched(false),
       _buf_matched(false),
+      _buf_error_pos(0),
       _pid(-1)
 {
+    _lines.set_limits(plux::default_max_lines(), plux::default_max_bytes());
 }
 
 int plux::ProcessBase::wait_pid(bool wait)
@@ -115,63 +120,177 @@ void plux::ProcessBase::output(const char* data, ssize_t size)
 {
     _shell_log->output(data, size);
 
-    for (ssize_t i = 0; i < size; i++) {
-        if (data[i] == '\n') {
-            if (! _buf.empty() && _buf[_buf.size() - 1] == '\r') {
-                _buf.erase(_buf.size() - 1);
-            }
+    // escape codes are removed from the whole chunk before it is
+    // split, sequences may span reads and lines.
+    if (_trim_special && _ansi_strip.strip(data, size, _stripped)) {
+        data = _stripped.data();
+        size = _stripped.size();
+    }
+
+    // append data up to each newline in one go, memchr is
+    // vectorized by the C library.
+    const char* end = data + size;
+    while (data < end) {
+        const char* nl =
+            static_cast<const char*>(memchr(data, '\n', end - data));
+        if (nl == nullptr) {
+            _buf.append(data, end - data);
+            break;
+        }
 
-            match_error(_buf, true);
+        _buf.append(data, nl - data);
+        data = nl + 1;
+        if (! _buf.empty() && _buf[_buf.size() - 1] == '\r') {
+            _buf.erase(_buf.size() - 1);
+        }
 
-            if (! _buf_matched) {
-                _lines.push_back(line_trim_special(_buf));
-            }
-            _buf = "";
-            _buf_matched = false;
+        match_error(_buf, true, _buf_error_pos);
+
+        uint64_t dropped = _lines.dropped();
+        _lines.push_back(std::move(_buf));
+        if (_lines.dropped() != dropped) {
+            lines_dropped(_lines.dropped() - dropped);
+        }
+        if (_buf_matched) {
+            // matched before it was complete, only kept as history.
+            _lines.consume_until(_lines.end());
         } else {
-            _buf += data[i];
+            match_line();
         }
+        _buf = _lines.take_buffer();
+        _buf_matched = false;
+        _buf_error_pos = 0;
+    }
+    match_error(_buf, false, _buf_error_pos);
+    _buf_error_pos = _buf.size();
+
+    size_t trimmed = _lines.trim_partial(_buf);
+    if (trimmed > 0) {
+        buf_dropped(trimmed);
     }
-    match_error(_buf, false);
 }
 
-std::string plux::ProcessBase::line_trim_special(const std::string& line)
+void plux::ProcessBase::line_consume_until(line_it it)
 {
-    if (! _trim_special) {
-        return line;
+    _lines.consume_until(it);
+    line_match_reset();
+}
+
+/**
+ * Get last lines read including the current incomplete line, if any.
+ */
+std::vector<std::string> plux::ProcessBase::line_tail(size_t num) const
+{
+    if (_buf.empty() || num == 0) {
+        return _lines.tail(num);
     }
+    auto lines = _lines.tail(num - 1);
+    lines.push_back(_buf);
+    return lines;
+}
 
-    std::string trimmed;
-    bool in_escape = false;
-    for (size_t i = 0; i < line.size(); i++) {
-        if (line[i] == 0x1b && line[i + 1] == '[') {
-            in_escape = true;
-        } else if (in_escape && line[i] == 'm') {
-            in_escape = false;
-        } else if (in_escape) {
-            // skip
-        } else {
-            trimmed += line[i];
-        }
+void plux::ProcessBase::line_match_reset(void)
+{
+    _line_cursor = 0;
+    _line_match.disarm();
+    _line_matched = false;
+    _lines.set_keep(LineStore::KEEP_NONE);
+}
+
+/**
+ * Lines before the newest line were dropped due to the retention
+ * limits, moving the pending match along. Output is kept in the shell
+ * log.
+ */
+void plux::ProcessBase::lines_dropped(uint64_t num)
+{
+    if (_lines.dropped() == num) {
+        _log.warning("shell", _name + " unmatched output over limit, "
+                     "dropping oldest lines");
+    }
+
+    // a matched line is kept by the store, only the cursor of a
+    // match still looking for its line can fall behind.
+    if (_line_cursor < num) {
+        _line_cursor = 0;
+    } else {
+        _line_cursor -= num;
     }
-    return trimmed;
 }
 
-void plux::ProcessBase::line_consume_until(line_it it)
+/**
+ * Bytes were dropped from the start of the incomplete line, output
+ * without newlines over the size limit. Output is kept in the shell
+ * log.
+ */
+void plux::ProcessBase::buf_dropped(size_t num)
 {
-    _lines.erase(_lines.begin(), it);
+    if (_lines.dropped_bytes() == num) {
+        _log.warning("shell", _name + " incomplete line over limit, "
+                     "dropping oldest bytes");
+    }
+    _buf_error_pos -= num;
 }
 
-void plux::ProcessBase::match_error(const std::string& line, bool is_line)
+/**
+ * Test the pending match on the line just read, done together with
+ * the error pattern to avoid scanning the line again when the task
+ * waiting for it is run.
+ */
+void plux::ProcessBase::match_line(void)
 {
-    if (_error_pattern.empty()) {
+    // lines are tested in order, earlier lines not yet checked are
+    // left to the match itself.
+    if (! _line_match.armed() || _line_matched
+        || _line_cursor != _lines.size() - 1) {
+        return;
+    }
+
+    try {
+        if (_line_match.match_line(_shell_env, _name, _lines.back())) {
+            _line_matched = true;
+            _lines.set_keep(_line_cursor);
+        } else {
+            _line_cursor = _lines.size();
+        }
+    } catch (const PluxException&) {
+        // report the error from the match when the task is run.
+        _line_match.disarm();
+    } catch (const plux::regex_error&) {
+        _line_match.disarm();
+    }
+}
+
+/**
+ * Match error pattern on line, the first pos bytes of the line have
+ * already been checked while the line was incomplete.
+ *
+ * Literal patterns resume where the previous check stopped. Regex
+ * patterns are only searched in a window before pos on incomplete
+ * lines, the complete line is searched in full once read.
+ */
+void plux::ProcessBase::match_error(const std::string& line, bool is_line,
+                                    size_t pos)
+{
+    if (_error_pattern.empty() || ! _error) {
         return;
     }
     if (! is_line && _error_pattern[_error_pattern.size() - 1] == '$') {
         return;
     }
 
-    if (plux::regex_search(line, _error)) {
+    bool matched;
+    if (_error_is_literal) {
+        size_t overlap = _error_pattern.size() - 1;
+        size_t start = pos > overlap ? pos - overlap : 0;
+        matched = line.find(_error_pattern, start) != std::string::npos;
+    } else if (is_line) {
+        matched = plux::regex_search(line, *_error);
+    } else {
+        size_t start = pos > ERROR_WINDOW ? pos - ERROR_WINDOW : 0;
+        matched = plux::regex_search(line, start, *_error);
+    }
+    if (matched) {
         throw ShellException(_name,
                              std::string("error pattern ") +
                              _error_pattern + " matched");
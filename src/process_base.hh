@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include "ansi_strip.hh"
 #include "log.hh"
 #include "plux.hh"
 #include "regex.hh"
@@ -21,6 +22,8 @@ namespace plux
                        const std::string& error);
         virtual ~ShellException(void) = default;
 
+        const std::string& shell(void) const { return _shell; }
+
         virtual std::string info(void) const override {
             return _shell + " " + _error;
         }
@@ -55,16 +58,18 @@ namespace plux
         virtual int wait_pid(bool wait);
 
         const std::string& name(void) const override { return _name; }
+        void set_name(const std::string& name) { _name = name; }
+        void set_shell_log(ShellLog* shell_log) { _shell_log = shell_log; }
         void progress_log(const std::string& msg) override;
         void progress_log(const std::string& context,
                           const std::string& msg) override;
 
         const std::string& error_pattern(void) const { return _error_pattern; }
         void set_error_pattern(const std::string& pattern) override {
-            _error_pattern = pattern;
             try {
-                _error = pattern;
+                _error = plux::regex_cache().get(pattern);
                 _error_pattern = pattern;
+                _error_is_literal = plux::regex_is_literal(pattern);
             } catch (const plux::regex_error& ex) {
                 throw ShellException(_name,
                                      std::string("invalid error pattern: ")
@@ -83,6 +88,23 @@ namespace plux
         line_it line_begin() override { return _lines.begin(); }
         line_it line_end() override { return _lines.end(); }
         void line_consume_until(line_it it) override;
+        std::vector<std::string> line_tail(size_t num) const override;
+        uint64_t lines_dropped(void) const override {
+            return _lines.dropped();
+        }
+        uint64_t bytes_dropped(void) const override {
+            return _lines.dropped_bytes();
+        }
+        size_t line_cursor(void) const override { return _line_cursor; }
+        void set_line_cursor(size_t cursor) override {
+            _line_cursor = cursor;
+        }
+        void set_line_match(const std::string& pattern,
+                            const RegexCache::regex_ptr& re) override {
+            _line_match.arm(pattern, re);
+        }
+        bool line_matched(void) const override { return _line_matched; }
+        void line_match_reset(void) override;
 
         const std::string& buf() const override {
             if (_buf_matched) {
@@ -100,7 +122,6 @@ namespace plux
         }
 
         bool stop_pid(bool wait);
-        std::string line_trim_special(const std::string& line);
         void log_and_throw_strerror(const std::string& msg);
 
         /** Application log. */
@@ -117,7 +138,15 @@ namespace plux
         int _exitstatus;
 
     private:
-        void match_error(const std::string& line, bool is_line);
+        /** Bytes before the unchecked part of an incomplete line
+         *  searched again by a regex error pattern. */
+        static const size_t ERROR_WINDOW = 1024;
+
+        void match_error(const std::string& line, bool is_line,
+                         size_t pos);
+        void match_line(void);
+        void lines_dropped(uint64_t num);
+        void buf_dropped(size_t num);
 
         /** Shell name. */
         std::string _name;
@@ -129,18 +158,32 @@ namespace plux
          *  it easier to write match patterns on pure text.
          */
         bool _trim_special;
+        /** Escape code state, kept between reads. */
+        AnsiStrip _ansi_strip;
+        /** Output with escape codes removed. */
+        std::string _stripped;
         /** Error pattern */
         std::string _error_pattern;
         /** Error pattern, if any line matches signal error. */
-        plux::regex _error;
+        plux::RegexCache::regex_ptr _error;
+        /** Error pattern has no special characters, use substring search. */
+        bool _error_is_literal;
 
         /** Line buffer */
-        std::vector<std::string> _lines;
+        LineStore _lines;
+        /** Lines already checked by the pending match. */
+        size_t _line_cursor;
+        /** Match pending on output, if armed. */
+        ShellMatch _line_match;
+        /** Set when the line at the cursor matched _line_match. */
+        bool _line_matched;
         /** Output buffer */
         std::string _buf;
-        /** Set to true when matching buf, will cause buf not to be
-            added to lines on newline. */
+        /** Set to true when matching buf, will cause buf to only be
+            kept as history on newline. */
         bool _buf_matched;
+        /** Bytes of buf checked by the error pattern. */
+        size_t _buf_error_pos;
 
         /** process pid */
         pid_t _pid;
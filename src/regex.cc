@@ -2,13 +2,20 @@
 
 namespace plux
 {
-#ifdef WORKING_CXX_REGEX
+#if defined(PLUX_STD_REGEX)
 
     bool regex_search(const std::string& s, const regex& e)
     {
         return std::regex_search(s, e);
     }
 
+    bool regex_search(const std::string& s, size_t pos, const regex& e)
+    {
+        auto flags = pos > 0 ? std::regex_constants::match_prev_avail
+                             : std::regex_constants::match_default;
+        return std::regex_search(s.begin() + pos, s.end(), e, flags);
+    }
+
     bool regex_search(const std::string& s, smatch& matches, const regex& e)
     {
         return std::regex_search(s, matches, e);
@@ -19,7 +26,44 @@ namespace plux
         return std::regex_match(s, e);
     }
 
-#else // ! WORKING_CXX_REGEX
+#elif defined(USE_NFA_REGEX)
+
+    bool regex_search(const std::string& s, const regex& e)
+    {
+        return e.exec(s, 0, false, nullptr);
+    }
+
+    bool regex_search(const std::string& s, size_t pos, const regex& e)
+    {
+        return e.exec(s, pos, false, nullptr);
+    }
+
+    bool regex_search(const std::string& s, smatch& matches, const regex& e)
+    {
+        static thread_local std::vector<ptrdiff_t> caps;
+        if (! e.exec(s, 0, false, &caps)) {
+            return false;
+        }
+
+        matches.clear();
+        for (size_t i = 0; i < caps.size(); i += 2) {
+            if (caps[i] == -1 || caps[i + 1] == -1) {
+                // group did not participate, leave as empty string
+                matches.push_back(sub_match());
+            } else {
+                matches.push_back(sub_match(s.c_str() + caps[i],
+                                            caps[i + 1] - caps[i]));
+            }
+        }
+        return true;
+    }
+
+    bool regex_match(const std::string& s, const regex& e)
+    {
+        return e.exec(s, 0, true, nullptr);
+    }
+
+#else // ! PLUX_STD_REGEX && ! USE_NFA_REGEX
 
     regex::regex(void)
         : _compiled(false)
@@ -52,6 +96,7 @@ namespace plux
         int err = regcomp(&_re, ext_pattern.c_str(), flags);
         if (! err) {
             _compiled = true;
+            _matches.resize(_re.re_nsub + 1);
         } else {
             char buf[128] = {0};
             regerror(err, &_re, buf, sizeof(buf));
@@ -66,8 +111,10 @@ namespace plux
         int in_group = 0;
         for (size_t i = 0; i < pattern.size(); i++) {
             if (in_escape) {
-                // \d works
                 switch (pattern[i]) {
+                case 'd':
+                    transform_add_group(ext_pattern, in_group, "[:digit:]");
+                    break;
                 case 'D':
                     transform_add_group(ext_pattern, in_group, "^[:digit:]");
                     break;
@@ -132,6 +179,16 @@ namespace plux
         return regexec(e.re(), s.c_str(), 0, nullptr, 0) == 0;
     }
 
+    bool regex_search(const std::string& s, size_t pos, const regex& e)
+    {
+        if (! e.compiled()) {
+            return false;
+        }
+
+        int eflags = pos > 0 ? REG_NOTBOL : 0;
+        return regexec(e.re(), s.c_str() + pos, 0, nullptr, eflags) == 0;
+    }
+
     bool regex_search(const std::string& s, smatch& matches, const regex& e)
     {
         if (! e.compiled()) {
@@ -139,25 +196,23 @@ namespace plux
         }
 
         const size_t max_ref = e.nsub() + 1;
-        auto r_matches = new regmatch_t[max_ref];
+        regmatch_t* r_matches = e.matches();
         if (regexec(e.re(), s.c_str(), max_ref, r_matches, 0)) {
-            delete [] r_matches;
             return false;
         }
 
+        matches.clear();
         for (size_t i = 0; i < max_ref; i++) {
-            std::string match;
             if (r_matches[i].rm_so == -1 || r_matches[i].rm_eo == -1) {
                 // no match, leave as empty string
+                matches.push_back(sub_match());
             } else {
                 auto size = r_matches[i].rm_eo - r_matches[i].rm_so;
-                match = std::string(s.c_str() + r_matches[i].rm_so, size);
+                matches.push_back(sub_match(s.c_str() + r_matches[i].rm_so,
+                                            size));
             }
-            matches.push_back(sub_match(match));
         }
 
-        delete [] r_matches;
-
         return true;
     }
 
@@ -173,5 +228,72 @@ namespace plux
             && (static_cast<size_t>(r_matches[0].rm_eo) == s.size());
     }
 
-#endif // WORKING_CXX_REGEX
+#endif // PLUX_STD_REGEX
+
+    /**
+     * Return true if pattern contains no special characters and can
+     * be matched with a plain substring search.
+     */
+    bool regex_is_literal(const std::string& pattern)
+    {
+        return ! pattern.empty()
+            && pattern.find_first_of("\\^$.|?*+()[]{}") == std::string::npos;
+    }
+
+    RegexCache::RegexCache(size_t capacity)
+        : _capacity(capacity > 0 ? capacity : 1)
+    {
+    }
+
+    /**
+     * Get compiled regex for pattern, compiling and caching it if not
+     * already present. Throws regex_error on invalid patterns, these
+     * are not cached.
+     */
+    RegexCache::regex_ptr RegexCache::get(const std::string& pattern)
+    {
+        auto it = _index.find(pattern);
+        if (it != _index.end()) {
+            _stats.hits++;
+            _entries.splice(_entries.begin(), _entries, it->second);
+            return it->second->second;
+        }
+
+        _stats.misses++;
+        regex_ptr re = std::make_shared<const regex>(pattern);
+        _entries.emplace_front(pattern, re);
+        _index[pattern] = _entries.begin();
+        evict();
+        return re;
+    }
+
+    void RegexCache::set_capacity(size_t capacity)
+    {
+        _capacity = capacity > 0 ? capacity : 1;
+        evict();
+    }
+
+    void RegexCache::clear(void)
+    {
+        _entries.clear();
+        _index.clear();
+    }
+
+    void RegexCache::evict(void)
+    {
+        while (_entries.size() > _capacity) {
+            _index.erase(_entries.back().first);
+            _entries.pop_back();
+            _stats.evictions++;
+        }
+    }
+
+    /**
+     * Cache shared by all lines and shells in the process.
+     */
+    RegexCache& regex_cache(void)
+    {
+        static RegexCache cache;
+        return cache;
+    }
 }
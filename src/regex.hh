@@ -2,42 +2,67 @@
 
 #include "config.h"
 
+#include <cstdint>
+#include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
 
-#ifdef WORKING_CXX_REGEX
+#if defined(WORKING_CXX_REGEX) && ! defined(USE_NFA_REGEX)
+#define PLUX_STD_REGEX
+#endif
+
+#ifdef PLUX_STD_REGEX
 #include <regex>
-#else // ! WORKING_CXX_REGEX
+#else // ! PLUX_STD_REGEX
+#include <cstring>
+#include <ostream>
 #include <vector>
 #include <stdexcept>
+#ifdef USE_NFA_REGEX
+#include <bitset>
+#else // ! USE_NFA_REGEX
 extern "C" {
 #include <regex.h>
 }
-#endif // WORKING_CXX_REGEX
+#endif // USE_NFA_REGEX
+#endif // PLUX_STD_REGEX
 
 namespace plux
 {
-#ifdef WORKING_CXX_REGEX
+#ifdef PLUX_STD_REGEX
 
     typedef std::regex regex;
     typedef std::regex_error regex_error;
     typedef std::smatch smatch;
 
-#else // ! WORKING_CXX_REGEX
+#else // ! PLUX_STD_REGEX
 
     /**
-     * C++ const_reference limited look-alike.
+     * C++11 sub_match limited look-alike, refers to the searched
+     * string which must outlive it. The string for the match is only
+     * created when str() is called.
      */
     class sub_match {
     public:
-        explicit sub_match(const std::string& str)
-            : _str(str)
+        sub_match(void)
+            : _first(""),
+              _len(0)
+        {
+        }
+        sub_match(const char* first, size_t len)
+            : _first(first),
+              _len(len)
         {
         }
 
-        const std::string& str(void) const { return _str; }
+        const char* data(void) const { return _first; }
+        size_t length(void) const { return _len; }
+        std::string str(void) const { return std::string(_first, _len); }
 
     private:
-        std::string _str;
+        const char* _first;
+        size_t _len;
     };
 
     /**
@@ -60,6 +85,82 @@ namespace plux
         virtual ~regex_error(void) { }
     };
 
+#ifdef USE_NFA_REGEX
+
+    /**
+     * Instruction in a compiled regex program.
+     */
+    struct regex_inst {
+        /** Operation, one of regex::op. */
+        uint8_t op;
+        /** Character, class index, save slot or jump target. */
+        uint32_t x;
+        /** Second jump target for split. */
+        uint32_t y;
+    };
+
+    /**
+     * C++11 regex limited look-alike, the pattern is compiled to a
+     * program run by a Pike VM making matching linear in the size of
+     * the input. Uses ECMAScript syntax without back references and
+     * look-ahead.
+     */
+    class regex {
+    public:
+        enum op {
+            OP_CHAR,
+            OP_CLASS,
+            OP_SPLIT,
+            OP_JMP,
+            OP_SAVE,
+            OP_BOL,
+            OP_EOL,
+            OP_WORD,
+            OP_NOT_WORD,
+            OP_MATCH
+        };
+
+        /** Upper limit on program size, patterns compiling to more
+         *  instructions are rejected. */
+        static const size_t MAX_INSTS = 65536;
+
+        regex(void);
+        explicit regex(const std::string& pattern);
+        regex(const regex& regex) = delete;
+
+        bool compiled() const { return ! _prog.empty(); }
+        size_t nsub(void) const { return _nsub; }
+
+        regex &operator=(const std::string& pattern) {
+            set(pattern);
+            return *this;
+        }
+
+        bool exec(const std::string& s, size_t pos, bool full,
+                  std::vector<ptrdiff_t>* caps) const;
+
+    private:
+        void set(const std::string& pattern);
+        void set_first(void);
+
+        /** Program, empty if not compiled. */
+        std::vector<regex_inst> _prog;
+        /** Character classes referenced by OP_CLASS. */
+        std::vector<std::bitset<256>> _classes;
+        /** Number of capture groups. */
+        size_t _nsub;
+        /** Pattern must match at the start of input. */
+        bool _anchored;
+        /** Set if all matches start with a character in _first. */
+        bool _has_first;
+        /** Characters a match can start with. */
+        std::bitset<256> _first;
+        /** Only character a match can start with, -1 if several. */
+        int _first_byte;
+    };
+
+#else // ! USE_NFA_REGEX
+
     /**
      * C++11 regex limited look-alike using regcomp/regex from libc.
      */
@@ -73,6 +174,9 @@ namespace plux
         bool compiled() const { return _compiled; }
         const regex_t* re(void) const { return &_re; }
         size_t nsub(void) const { return _re.re_nsub; }
+        /** Match offsets for regexec, nsub() + 1 entries. Reused
+         *  between searches, a regex can not be searched concurrently. */
+        regmatch_t* matches(void) const { return _matches.data(); }
 
         regex &operator=(const std::string& pattern) {
             set(pattern);
@@ -88,29 +192,91 @@ namespace plux
 
         regex_t _re;
         bool _compiled;
+        mutable std::vector<regmatch_t> _matches;
     };
 
-#endif // WORKING_CXX_REGEX
+#endif // USE_NFA_REGEX
+#endif // PLUX_STD_REGEX
 
     bool regex_search(const std::string& s, const regex& e);
+    /** Search s from pos, pos is not treated as the start of line. */
+    bool regex_search(const std::string& s, size_t pos, const regex& e);
     bool regex_search(const std::string& s, smatch& matches, const regex& e);
     bool regex_match(const std::string& s, const regex& e);
+    bool regex_is_literal(const std::string& pattern);
+
+    /**
+     * Lookup statistics for RegexCache.
+     */
+    struct RegexCacheStats {
+        RegexCacheStats(void)
+            : hits(0),
+              misses(0),
+              evictions(0)
+        {
+        }
+
+        /** Lookups served from the cache. */
+        uint64_t hits;
+        /** Lookups that required compiling the pattern. */
+        uint64_t misses;
+        /** Entries dropped to keep the cache within capacity. */
+        uint64_t evictions;
+    };
+
+    /**
+     * Bounded cache of compiled regular expressions keyed by pattern,
+     * least recently used entries are evicted first.
+     */
+    class RegexCache {
+    public:
+        typedef std::shared_ptr<const regex> regex_ptr;
+
+        static const size_t DEFAULT_CAPACITY = 256;
+
+        explicit RegexCache(size_t capacity = DEFAULT_CAPACITY);
+
+        regex_ptr get(const std::string& pattern);
+
+        size_t size(void) const { return _entries.size(); }
+        size_t capacity(void) const { return _capacity; }
+        void set_capacity(size_t capacity);
+        void clear(void);
+
+        const RegexCacheStats& stats(void) const { return _stats; }
+
+    private:
+        typedef std::list<std::pair<std::string, regex_ptr>> entry_list;
+
+        void evict(void);
+
+        /** Maximum number of entries, at least one. */
+        size_t _capacity;
+        /** Entries, most recently used first. */
+        entry_list _entries;
+        /** Pattern to entry lookup. */
+        std::unordered_map<std::string, entry_list::iterator> _index;
+        RegexCacheStats _stats;
+    };
+
+    RegexCache& regex_cache(void);
 }
 
-#ifndef WORKING_CXX_REGEX
+#ifndef PLUX_STD_REGEX
 inline std::ostream& operator<<(std::ostream& ost, const plux::sub_match& sm)
 {
-    ost << sm.str();
+    ost.write(sm.data(), sm.length());
     return ost;
 }
 
 inline bool operator==(const std::string& lhs, const plux::sub_match& rhs)
 {
-    return lhs == rhs.str();
+    return lhs.compare(0, lhs.size(), rhs.data(), rhs.length()) == 0;
 }
 
 inline bool operator==(const char* lhs, const plux::sub_match& rhs)
 {
-    return rhs.str() == lhs;
+    return strlen(lhs) == rhs.length()
+        && memcmp(lhs, rhs.data(), rhs.length()) == 0;
 }
-#endif // WORKING_CXX_REGEX
+#endif // PLUX_STD_REGEX
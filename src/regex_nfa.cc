@@ -0,0 +1,1002 @@
+#include "regex.hh"
+
+#ifdef USE_NFA_REGEX
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace plux
+{
+    /** Upper limit for {n,m} repeat counts. */
+    static const int MAX_REPEAT = 1000;
+    /** Repeat without upper limit. */
+    static const int REPEAT_INF = -1;
+
+    static bool is_word(unsigned char c)
+    {
+        return isalnum(c) || c == '_';
+    }
+
+    /**
+     * Parsed regular expression node.
+     */
+    struct RegexNode {
+        enum type {
+            EMPTY,
+            CHAR,
+            CLASS,
+            CAT,
+            ALT,
+            REPEAT,
+            GROUP,
+            BOL,
+            EOL,
+            WORD,
+            NOT_WORD
+        };
+
+        explicit RegexNode(enum type type_, int val_ = 0)
+            : type(type_),
+              val(val_),
+              min(0),
+              max(0),
+              greedy(true)
+        {
+        }
+
+        enum type type;
+        /** Character, class index or group number (-1 if not captured). */
+        int val;
+        int min;
+        int max;
+        bool greedy;
+        std::vector<size_t> children;
+    };
+
+    /**
+     * Recursive descent parser producing RegexNode trees, nodes are
+     * referenced by index into the node vector.
+     */
+    class RegexParser {
+    public:
+        RegexParser(const std::string& pattern,
+                    std::vector<RegexNode>& nodes,
+                    std::vector<std::bitset<256>>& classes)
+            : _pattern(pattern),
+              _pos(0),
+              _nodes(nodes),
+              _classes(classes),
+              _nsub(0)
+        {
+        }
+
+        size_t parse(void)
+        {
+            size_t node = parse_alt();
+            if (_pos < _pattern.size()) {
+                error("unmatched )");
+            }
+            return node;
+        }
+
+        size_t nsub(void) const { return _nsub; }
+
+    private:
+        [[noreturn]] void error(const std::string& msg)
+        {
+            throw regex_error(msg + " at position " + std::to_string(_pos));
+        }
+
+        bool at_end(void) const { return _pos >= _pattern.size(); }
+        char peek(void) const { return _pattern[_pos]; }
+
+        size_t add(const RegexNode& node)
+        {
+            _nodes.push_back(node);
+            return _nodes.size() - 1;
+        }
+
+        size_t add_class(const std::bitset<256>& cls)
+        {
+            _classes.push_back(cls);
+            return add(RegexNode(RegexNode::CLASS, _classes.size() - 1));
+        }
+
+        size_t parse_alt(void)
+        {
+            size_t node = parse_cat();
+            if (at_end() || peek() != '|') {
+                return node;
+            }
+
+            RegexNode alt(RegexNode::ALT);
+            alt.children.push_back(node);
+            while (! at_end() && peek() == '|') {
+                _pos++;
+                alt.children.push_back(parse_cat());
+            }
+            return add(alt);
+        }
+
+        size_t parse_cat(void)
+        {
+            RegexNode cat(RegexNode::CAT);
+            while (! at_end() && peek() != '|' && peek() != ')') {
+                cat.children.push_back(parse_repeat(parse_atom()));
+            }
+            if (cat.children.empty()) {
+                return add(RegexNode(RegexNode::EMPTY));
+            } else if (cat.children.size() == 1) {
+                return cat.children[0];
+            }
+            return add(cat);
+        }
+
+        size_t parse_repeat(size_t atom)
+        {
+            if (at_end()) {
+                return atom;
+            }
+
+            int min, max;
+            char c = peek();
+            if (c == '*') {
+                min = 0;
+                max = REPEAT_INF;
+                _pos++;
+            } else if (c == '+') {
+                min = 1;
+                max = REPEAT_INF;
+                _pos++;
+            } else if (c == '?') {
+                min = 0;
+                max = 1;
+                _pos++;
+            } else if (c != '{' || ! parse_brace(min, max)) {
+                return atom;
+            }
+
+            RegexNode repeat(RegexNode::REPEAT);
+            repeat.min = min;
+            repeat.max = max;
+            repeat.children.push_back(atom);
+            if (! at_end() && peek() == '?') {
+                repeat.greedy = false;
+                _pos++;
+            }
+            if (! at_end() && is_quantifier()) {
+                error("nothing to repeat");
+            }
+            return add(repeat);
+        }
+
+        /**
+         * Parse {n}, {n,} or {n,m}, a { not starting a valid
+         * quantifier is a literal and leaves the position untouched.
+         */
+        bool parse_brace(int& min, int& max)
+        {
+            size_t pos = _pos + 1;
+            if (! parse_int(pos, min)) {
+                return false;
+            }
+            max = min;
+            if (pos < _pattern.size() && _pattern[pos] == ',') {
+                pos++;
+                if (! parse_int(pos, max)) {
+                    max = REPEAT_INF;
+                }
+            }
+            if (pos >= _pattern.size() || _pattern[pos] != '}') {
+                return false;
+            }
+            _pos = pos + 1;
+
+            if (min > MAX_REPEAT || max > MAX_REPEAT) {
+                error("repeat count too large");
+            } else if (max != REPEAT_INF && max < min) {
+                error("invalid repeat range");
+            }
+            return true;
+        }
+
+        bool parse_int(size_t& pos, int& val)
+        {
+            size_t start = pos;
+            val = 0;
+            while (pos < _pattern.size() && isdigit(_pattern[pos])) {
+                if (val <= MAX_REPEAT) {
+                    val = val * 10 + (_pattern[pos] - '0');
+                }
+                pos++;
+            }
+            return pos > start;
+        }
+
+        bool is_quantifier(void)
+        {
+            char c = peek();
+            if (c == '*' || c == '+' || c == '?') {
+                return true;
+            }
+            int min, max;
+            size_t pos = _pos;
+            bool is_brace = c == '{' && parse_brace(min, max);
+            _pos = pos;
+            return is_brace;
+        }
+
+        size_t parse_atom(void)
+        {
+            if (is_quantifier()) {
+                error("nothing to repeat");
+            }
+
+            char c = _pattern[_pos++];
+            switch (c) {
+            case '(':
+                return parse_group();
+            case '[':
+                return parse_class();
+            case '.': {
+                std::bitset<256> cls;
+                cls.set();
+                cls.reset('\n');
+                cls.reset('\r');
+                return add_class(cls);
+            }
+            case '^':
+                return add(RegexNode(RegexNode::BOL));
+            case '$':
+                return add(RegexNode(RegexNode::EOL));
+            case '\\':
+                return parse_escape();
+            default:
+                return add(RegexNode(RegexNode::CHAR,
+                                     static_cast<unsigned char>(c)));
+            }
+        }
+
+        size_t parse_group(void)
+        {
+            int group = -1;
+            if (! at_end() && peek() == '?') {
+                if (_pos + 1 < _pattern.size() && _pattern[_pos + 1] == ':') {
+                    _pos += 2;
+                } else {
+                    error("look-ahead is not supported");
+                }
+            } else {
+                group = ++_nsub;
+            }
+
+            size_t child = parse_alt();
+            if (at_end() || peek() != ')') {
+                error("unmatched (");
+            }
+            _pos++;
+
+            RegexNode node(RegexNode::GROUP, group);
+            node.children.push_back(child);
+            return add(node);
+        }
+
+        size_t parse_escape(void)
+        {
+            if (at_end()) {
+                error("trailing \\");
+            }
+
+            char c = _pattern[_pos];
+            if (c == 'b') {
+                _pos++;
+                return add(RegexNode(RegexNode::WORD));
+            } else if (c == 'B') {
+                _pos++;
+                return add(RegexNode(RegexNode::NOT_WORD));
+            } else if (c >= '1' && c <= '9') {
+                error("back references are not supported");
+            }
+
+            std::bitset<256> cls;
+            if (parse_escape_class(cls)) {
+                return add_class(cls);
+            }
+            return add(RegexNode(RegexNode::CHAR, parse_escape_char()));
+        }
+
+        /**
+         * Parse \d, \s, \w and their negations into cls.
+         */
+        bool parse_escape_class(std::bitset<256>& cls)
+        {
+            unsigned char c = _pattern[_pos];
+            int (*fun)(int);
+            switch (tolower(c)) {
+            case 'd':
+                fun = isdigit;
+                break;
+            case 's':
+                fun = isspace;
+                break;
+            case 'w':
+                fun = nullptr;
+                break;
+            default:
+                return false;
+            }
+            _pos++;
+
+            for (int i = 0; i < 256; i++) {
+                cls[i] = fun ? fun(i) != 0 : is_word(i);
+            }
+            if (isupper(c)) {
+                cls.flip();
+            }
+            return true;
+        }
+
+        /**
+         * Parse escaped character after \, anything not a known
+         * escape is taken literally.
+         */
+        int parse_escape_char(void)
+        {
+            char c = _pattern[_pos++];
+            switch (c) {
+            case 't':
+                return '\t';
+            case 'n':
+                return '\n';
+            case 'r':
+                return '\r';
+            case 'f':
+                return '\f';
+            case 'v':
+                return '\v';
+            case '0':
+                return '\0';
+            case 'c':
+                if (! at_end() && isalpha(peek())) {
+                    return _pattern[_pos++] % 32;
+                }
+                // not a control escape, c is a literal
+                _pos--;
+                return '\\';
+            case 'x':
+                return parse_hex(2);
+            case 'u': {
+                int val = parse_hex(4);
+                if (val > 255) {
+                    error("unicode escape out of range");
+                }
+                return val;
+            }
+            default:
+                return static_cast<unsigned char>(c);
+            }
+        }
+
+        int parse_hex(size_t num)
+        {
+            if (_pos + num > _pattern.size()) {
+                error("incomplete hex escape");
+            }
+            int val = 0;
+            for (size_t i = 0; i < num; i++) {
+                char c = _pattern[_pos++];
+                if (! isxdigit(c)) {
+                    error("invalid hex escape");
+                }
+                val = val * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+            }
+            return val;
+        }
+
+        size_t parse_class(void)
+        {
+            std::bitset<256> cls;
+            bool negate = false;
+            if (! at_end() && peek() == '^') {
+                negate = true;
+                _pos++;
+            }
+
+            while (! at_end() && peek() != ']') {
+                int first;
+                if (! parse_class_atom(cls, first)) {
+                    continue;
+                }
+
+                // range, - first or last in the class is a literal
+                if (_pos + 1 < _pattern.size() && peek() == '-'
+                    && _pattern[_pos + 1] != ']') {
+                    _pos++;
+                    int last;
+                    if (! parse_class_atom(cls, last)) {
+                        error("invalid range in character class");
+                    }
+                    if (last < first) {
+                        error("invalid range in character class");
+                    }
+                    for (int i = first; i <= last; i++) {
+                        cls.set(i);
+                    }
+                } else {
+                    cls.set(first);
+                }
+            }
+            if (at_end()) {
+                error("unmatched [");
+            }
+            _pos++;
+
+            if (negate) {
+                cls.flip();
+            }
+            return add_class(cls);
+        }
+
+        /**
+         * Parse single class member, classes such as \d and
+         * [:digit:] are added to cls directly and return false.
+         */
+        bool parse_class_atom(std::bitset<256>& cls, int& c)
+        {
+            if (peek() == '[' && _pos + 1 < _pattern.size()
+                && _pattern[_pos + 1] == ':') {
+                parse_class_name(cls);
+                return false;
+            }
+
+            c = static_cast<unsigned char>(_pattern[_pos++]);
+            if (c != '\\') {
+                return true;
+            }
+            if (at_end()) {
+                error("trailing \\");
+            }
+            if (parse_escape_class(cls)) {
+                return false;
+            }
+            if (peek() == 'b') {
+                _pos++;
+                c = '\b';
+            } else {
+                c = parse_escape_char();
+            }
+            return true;
+        }
+
+        void parse_class_name(std::bitset<256>& cls)
+        {
+            size_t end = _pattern.find(":]", _pos + 2);
+            if (end == std::string::npos) {
+                error("unmatched [:");
+            }
+            std::string name = _pattern.substr(_pos + 2, end - _pos - 2);
+            _pos = end + 2;
+
+            static const struct {
+                const char* name;
+                int (*fun)(int);
+            } names[] = {
+                {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+                {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+                {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+                {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit}
+            };
+            for (auto& it : names) {
+                if (name == it.name) {
+                    for (int i = 0; i < 256; i++) {
+                        if (it.fun(i)) {
+                            cls.set(i);
+                        }
+                    }
+                    return;
+                }
+            }
+            error("unknown character class " + name);
+        }
+
+        const std::string& _pattern;
+        size_t _pos;
+        std::vector<RegexNode>& _nodes;
+        std::vector<std::bitset<256>>& _classes;
+        size_t _nsub;
+    };
+
+    /**
+     * Generate program from parsed nodes.
+     */
+    class RegexCompiler {
+    public:
+        RegexCompiler(const std::vector<RegexNode>& nodes,
+                      std::vector<regex_inst>& prog)
+            : _nodes(nodes),
+              _prog(prog)
+        {
+        }
+
+        void compile(size_t node)
+        {
+            emit(regex::OP_SAVE, 0);
+            gen(node);
+            emit(regex::OP_SAVE, 1);
+            emit(regex::OP_MATCH);
+        }
+
+    private:
+        size_t emit(enum regex::op op, uint32_t x = 0, uint32_t y = 0)
+        {
+            if (_prog.size() >= regex::MAX_INSTS) {
+                throw regex_error("regular expression too large");
+            }
+            regex_inst inst;
+            inst.op = op;
+            inst.x = x;
+            inst.y = y;
+            _prog.push_back(inst);
+            return _prog.size() - 1;
+        }
+
+        uint32_t pc(void) const { return _prog.size(); }
+
+        void gen(size_t idx)
+        {
+            const RegexNode& node = _nodes[idx];
+            switch (node.type) {
+            case RegexNode::EMPTY:
+                break;
+            case RegexNode::CHAR:
+                emit(regex::OP_CHAR, node.val);
+                break;
+            case RegexNode::CLASS:
+                emit(regex::OP_CLASS, node.val);
+                break;
+            case RegexNode::CAT:
+                for (auto child : node.children) {
+                    gen(child);
+                }
+                break;
+            case RegexNode::ALT:
+                gen_alt(node);
+                break;
+            case RegexNode::REPEAT:
+                gen_repeat(node);
+                break;
+            case RegexNode::GROUP:
+                if (node.val == -1) {
+                    gen(node.children[0]);
+                } else {
+                    emit(regex::OP_SAVE, node.val * 2);
+                    gen(node.children[0]);
+                    emit(regex::OP_SAVE, node.val * 2 + 1);
+                }
+                break;
+            case RegexNode::BOL:
+                emit(regex::OP_BOL);
+                break;
+            case RegexNode::EOL:
+                emit(regex::OP_EOL);
+                break;
+            case RegexNode::WORD:
+                emit(regex::OP_WORD);
+                break;
+            case RegexNode::NOT_WORD:
+                emit(regex::OP_NOT_WORD);
+                break;
+            }
+        }
+
+        /**
+         * a|b|c, earlier alternatives have priority.
+         */
+        void gen_alt(const RegexNode& node)
+        {
+            std::vector<size_t> jumps;
+            for (size_t i = 0; i < node.children.size(); i++) {
+                if (i + 1 < node.children.size()) {
+                    size_t split = emit(regex::OP_SPLIT);
+                    _prog[split].x = pc();
+                    gen(node.children[i]);
+                    jumps.push_back(emit(regex::OP_JMP));
+                    _prog[split].y = pc();
+                } else {
+                    gen(node.children[i]);
+                }
+            }
+            for (auto jmp : jumps) {
+                _prog[jmp].x = pc();
+            }
+        }
+
+        /**
+         * x{min,max} is generated as min copies of x followed by
+         * either x* or (max - min) nested optional copies.
+         */
+        void gen_repeat(const RegexNode& node)
+        {
+            size_t child = node.children[0];
+            for (int i = 0; i < node.min; i++) {
+                gen(child);
+            }
+
+            if (node.max == REPEAT_INF) {
+                uint32_t loop = pc();
+                size_t split = emit(regex::OP_SPLIT);
+                gen(child);
+                emit(regex::OP_JMP, loop);
+                set_split(split, loop + 1, pc(), node.greedy);
+            } else {
+                std::vector<size_t> splits;
+                for (int i = node.min; i < node.max; i++) {
+                    size_t split = emit(regex::OP_SPLIT);
+                    splits.push_back(split);
+                    gen(child);
+                }
+                for (auto split : splits) {
+                    set_split(split, split + 1, pc(), node.greedy);
+                }
+            }
+        }
+
+        void set_split(size_t split, uint32_t body, uint32_t skip,
+                       bool greedy)
+        {
+            _prog[split].x = greedy ? body : skip;
+            _prog[split].y = greedy ? skip : body;
+        }
+
+        const std::vector<RegexNode>& _nodes;
+        std::vector<regex_inst>& _prog;
+    };
+
+    /**
+     * Thread list for the Pike VM, sparse set of program counters
+     * with capture slots for each thread.
+     */
+    class RegexThreads {
+    public:
+        RegexThreads(void)
+            : _num_caps(0),
+              _size(0),
+              _num_marked(0)
+        {
+        }
+
+        /**
+         * Clear list and make room for a program of num_insts
+         * instructions, storage is only ever grown.
+         */
+        void reset(size_t num_insts, size_t num_caps)
+        {
+            if (_sparse.size() < num_insts) {
+                _sparse.resize(num_insts);
+                _dense.resize(num_insts);
+                _marked.resize(num_insts);
+            }
+            if (_caps.size() < num_insts * num_caps) {
+                _caps.resize(num_insts * num_caps);
+            }
+            _num_caps = num_caps;
+            clear();
+        }
+
+        void clear(void)
+        {
+            _size = 0;
+            _num_marked = 0;
+        }
+
+        size_t size(void) const { return _size; }
+        uint32_t pc(size_t i) const { return _dense[i]; }
+        ptrdiff_t* caps(size_t i) { return &_caps[i * _num_caps]; }
+
+        /**
+         * Mark pc as visited, returns false if already visited.
+         */
+        bool mark(uint32_t pc)
+        {
+            size_t i = _sparse[pc];
+            if (i < _num_marked && _marked[i] == pc) {
+                return false;
+            }
+            _sparse[pc] = _num_marked;
+            _marked[_num_marked++] = pc;
+            return true;
+        }
+
+        void add(uint32_t pc, const ptrdiff_t* caps)
+        {
+            _dense[_size] = pc;
+            std::copy(caps, caps + _num_caps, this->caps(_size));
+            _size++;
+        }
+
+    private:
+        std::vector<size_t> _sparse;
+        std::vector<uint32_t> _dense;
+        std::vector<ptrdiff_t> _caps;
+        size_t _num_caps;
+        std::vector<uint32_t> _marked;
+        size_t _size;
+        size_t _num_marked;
+    };
+
+    /**
+     * Entry on the add_thread stack.
+     */
+    struct RegexStackEntry {
+        uint32_t pc;
+        /** Capture slot to restore, -1 for a pc to follow. */
+        ptrdiff_t slot;
+        ptrdiff_t val;
+    };
+
+    /**
+     * Storage used while running a program, kept between calls to
+     * avoid allocating on each search.
+     */
+    struct RegexScratch {
+        RegexThreads list_a;
+        RegexThreads list_b;
+        std::vector<ptrdiff_t> thread_caps;
+        std::vector<ptrdiff_t> match_caps;
+        std::vector<RegexStackEntry> stack;
+    };
+
+    regex::regex(void)
+        : _nsub(0),
+          _anchored(false),
+          _has_first(false),
+          _first_byte(-1)
+    {
+    }
+
+    regex::regex(const std::string& pattern)
+        : regex()
+    {
+        set(pattern);
+    }
+
+    void regex::set(const std::string& pattern)
+    {
+        _prog.clear();
+        _classes.clear();
+
+        std::vector<RegexNode> nodes;
+        RegexParser parser(pattern, nodes, _classes);
+        size_t root = parser.parse();
+
+        std::vector<regex_inst> prog;
+        RegexCompiler compiler(nodes, prog);
+        compiler.compile(root);
+
+        _prog.swap(prog);
+        _nsub = parser.nsub();
+        _anchored = _prog.size() > 1 && _prog[1].op == OP_BOL;
+        set_first();
+    }
+
+    /**
+     * Collect the characters a match can start with, used to skip
+     * ahead in the input without running the VM.
+     */
+    void regex::set_first(void)
+    {
+        _first.reset();
+        _has_first = false;
+        _first_byte = -1;
+
+        std::vector<bool> seen(_prog.size());
+        std::vector<uint32_t> stack(1, 0);
+        while (! stack.empty()) {
+            uint32_t pc = stack.back();
+            stack.pop_back();
+            if (seen[pc]) {
+                continue;
+            }
+            seen[pc] = true;
+
+            const regex_inst& inst = _prog[pc];
+            switch (inst.op) {
+            case OP_CHAR:
+                _first.set(inst.x);
+                break;
+            case OP_CLASS:
+                _first |= _classes[inst.x];
+                break;
+            case OP_SPLIT:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case OP_JMP:
+                stack.push_back(inst.x);
+                break;
+            case OP_SAVE:
+                stack.push_back(pc + 1);
+                break;
+            default:
+                // assertion or empty match, any position may match
+                return;
+            }
+        }
+        _has_first = true;
+        if (_first.count() == 1) {
+            for (int c = 0; c < 256; c++) {
+                if (_first[c]) {
+                    _first_byte = c;
+                }
+            }
+        }
+    }
+
+    /**
+     * Run program on s starting at pos, pos is not the start of line
+     * if > 0. If full is true the match must cover all of s. On match
+     * caps, if given, is filled with start and end offset of each
+     * group, -1 for groups not part of the match.
+     */
+    bool regex::exec(const std::string& s, size_t pos, bool full,
+                     std::vector<ptrdiff_t>* caps) const
+    {
+        if (_prog.empty() || pos > s.size()) {
+            return false;
+        }
+        if ((_anchored || full) && pos > 0) {
+            return false;
+        }
+
+        const size_t num_caps = (_nsub + 1) * 2;
+        const unsigned char* str =
+            reinterpret_cast<const unsigned char*>(s.data());
+        const size_t end = s.size();
+
+        static thread_local RegexScratch scratch;
+        scratch.list_a.reset(_prog.size(), num_caps);
+        scratch.list_b.reset(_prog.size(), num_caps);
+        RegexThreads* clist = &scratch.list_a;
+        RegexThreads* nlist = &scratch.list_b;
+
+        std::vector<ptrdiff_t>& thread_caps = scratch.thread_caps;
+        thread_caps.resize(num_caps);
+        std::vector<ptrdiff_t>& match_caps = scratch.match_caps;
+        bool matched = false;
+
+        std::vector<RegexStackEntry>& stack = scratch.stack;
+        stack.clear();
+
+        // follow pc through non-consuming instructions adding
+        // threads in priority order.
+        auto add_thread = [&](RegexThreads& list, uint32_t pc0, size_t sp) {
+            stack.push_back(RegexStackEntry{pc0, -1, 0});
+            while (! stack.empty()) {
+                RegexStackEntry entry = stack.back();
+                stack.pop_back();
+                if (entry.slot != -1) {
+                    thread_caps[entry.slot] = entry.val;
+                    continue;
+                }
+
+                uint32_t pc = entry.pc;
+                while (list.mark(pc)) {
+                    const regex_inst& inst = _prog[pc];
+                    bool follow = false;
+                    switch (inst.op) {
+                    case OP_JMP:
+                        pc = inst.x;
+                        follow = true;
+                        break;
+                    case OP_SPLIT:
+                        stack.push_back(RegexStackEntry{inst.y, -1, 0});
+                        pc = inst.x;
+                        follow = true;
+                        break;
+                    case OP_SAVE:
+                        stack.push_back(RegexStackEntry{
+                                0, inst.x, thread_caps[inst.x]});
+                        thread_caps[inst.x] = sp;
+                        pc++;
+                        follow = true;
+                        break;
+                    case OP_BOL:
+                        follow = sp == 0;
+                        pc++;
+                        break;
+                    case OP_EOL:
+                        follow = sp == end;
+                        pc++;
+                        break;
+                    case OP_WORD:
+                    case OP_NOT_WORD: {
+                        bool before = sp > 0 && is_word(str[sp - 1]);
+                        bool after = sp < end && is_word(str[sp]);
+                        follow = (before != after) == (inst.op == OP_WORD);
+                        pc++;
+                        break;
+                    }
+                    default:
+                        list.add(pc, thread_caps.data());
+                        break;
+                    }
+                    if (! follow) {
+                        break;
+                    }
+                }
+            }
+        };
+
+        for (size_t sp = pos; ; sp++) {
+            if (! matched && (sp == pos || ! (_anchored || full))) {
+                if (clist->size() == 0 && _has_first && ! full) {
+                    // no thread running, skip to next possible start
+                    if (_first_byte != -1) {
+                        auto next = static_cast<const unsigned char*>(
+                            memchr(str + sp, _first_byte, end - sp));
+                        sp = next ? next - str : end;
+                    } else {
+                        while (sp < end && ! _first[str[sp]]) {
+                            sp++;
+                        }
+                    }
+                    if (sp == end) {
+                        break;
+                    }
+                }
+                std::fill(thread_caps.begin(), thread_caps.end(), -1);
+                add_thread(*clist, 0, sp);
+            }
+            if (clist->size() == 0) {
+                if (matched || _anchored || full || sp >= end) {
+                    break;
+                }
+                // start failed on an assertion, try next position
+                clist->clear();
+                continue;
+            }
+
+            nlist->clear();
+            for (size_t i = 0; i < clist->size(); i++) {
+                const regex_inst& inst = _prog[clist->pc(i)];
+                bool step = false;
+                switch (inst.op) {
+                case OP_MATCH:
+                    if (full && sp != end) {
+                        continue;
+                    }
+                    matched = true;
+                    match_caps.assign(clist->caps(i),
+                                      clist->caps(i) + num_caps);
+                    // lower priority threads are cut off
+                    i = clist->size();
+                    continue;
+                case OP_CHAR:
+                    step = sp < end && str[sp] == inst.x;
+                    break;
+                case OP_CLASS:
+                    step = sp < end && _classes[inst.x][str[sp]];
+                    break;
+                }
+                if (step) {
+                    std::copy(clist->caps(i), clist->caps(i) + num_caps,
+                              thread_caps.begin());
+                    add_thread(*nlist, clist->pc(i) + 1, sp + 1);
+                }
+            }
+            std::swap(clist, nlist);
+
+            if (sp >= end) {
+                break;
+            }
+        }
+
+        if (matched && caps) {
+            caps->assign(match_caps.begin(), match_caps.end());
+        }
+        return matched;
+    }
+}
+
+#endif // USE_NFA_REGEX
@@ -21,8 +21,8 @@ namespace plux
 
     LineRes LineVarAssignGlobal::run(ShellCtx& ctx, ShellEnv& env)
     {
-        auto exp_key = expand_var(env, ctx.name(), key());
-        auto exp_val = expand_var(env, ctx.name(), val());
+        auto exp_key = expand_key(env, ctx.name());
+        auto exp_val = expand_val(env, ctx.name());
         env.set_env("", exp_key, VAR_SCOPE_GLOBAL, exp_val);
         return LineRes(RES_OK);
     }
@@ -34,20 +34,20 @@ namespace plux
 
     LineRes LineProgress::run(ShellCtx& ctx, ShellEnv& env)
     {
-        std::string progress_msg = expand_var(env, ctx.name(), msg());
+        std::string progress_msg = expand_msg(env, ctx.name());
         ctx.progress_log(progress_msg);
         return LineRes(RES_OK);
     }
 
     std::string LineProgress::to_string(void) const
     {
-        return "LineProgress " + _msg;
+        return "LineProgress " + msg();
     }
 
     LineRes LineLog::run(ShellCtx& ctx, ShellEnv& env)
     {
         std::string context = file() + ":" + std::to_string(line());
-        std::string log_msg = expand_var(env, ctx.name(), msg());
+        std::string log_msg = expand_msg(env, ctx.name());
         ctx.progress_log(context, log_msg + plux::COLOR_RESET);
         return LineRes(RES_OK);
     }
@@ -59,36 +59,36 @@ namespace plux
 
     LineRes LineCall::run(ShellCtx& ctx, ShellEnv& env)
     {
-        auto fun_name = expand_var(env, ctx.name(), _name);
+        auto fun_name = _name.expand(env, ctx.name());
         std::vector<std::string> args;
         std::transform(_args.begin(), _args.end(), std::back_inserter(args),
-                       [this, &ctx, &env](const std::string& arg) {
-                           return expand_var(env, ctx.name(), arg);
+                       [this, &ctx, &env](const VarTemplate& arg) {
+                           return arg.expand(env, ctx.name());
                        });
         return LineRes(RES_CALL, fun_name, args);
     }
 
     std::string LineCall::to_string(void) const
     {
-        return std::string("LineCall ") + _name;
+        return std::string("LineCall ") + name();
     }
 
     LineRes LineSetErrorPattern::run(ShellCtx& ctx, ShellEnv& env)
     {
-        std::string error_pattern = expand_var(env, ctx.name(), _pattern);
+        std::string error_pattern = _pattern.expand(env, ctx.name());
         ctx.set_error_pattern(error_pattern);
         return LineRes(RES_OK);
     }
 
     std::string LineSetErrorPattern::to_string(void) const
     {
-        return "LineSetErrorPattern " + _pattern;
+        return "LineSetErrorPattern " + pattern();
     }
 
     LineRes LineVarAssignShell::run(ShellCtx& ctx, ShellEnv& env)
     {
-        auto exp_key = expand_var(env, ctx.name(), key());
-        auto exp_val = expand_var(env, ctx.name(), val());
+        auto exp_key = expand_key(env, ctx.name());
+        auto exp_val = expand_val(env, ctx.name());
         env.set_env(ctx.name(), exp_key, VAR_SCOPE_SHELL, exp_val);
         return LineRes(RES_OK);
     }
@@ -100,22 +100,22 @@ namespace plux
 
     LineRes LineOutput::run(ShellCtx& ctx, ShellEnv& env)
     {
-        std::string expanded_output = expand_var(env, shell(), _output);
-        ctx.input(expanded_output);
+        std::string buf;
+        ctx.input(_output.expand(env, shell(), buf));
         return LineRes(RES_OK);
     }
 
     std::string LineOutput::to_string(void) const
     {
         return std::string("LineOutput ") +
-            _output.substr(0, _output.size() - 1);
+            output().substr(0, output().size() - 1);
     }
 
     LineRes LineOutputFormat::run(ShellCtx& ctx, ShellEnv& env)
     {
         OutputFormat::string_vector expanded_args;
-        for (auto &arg : _args) {
-            expanded_args.push_back(expand_var(env, shell(), arg));
+        for (auto &arg : _arg_templates) {
+            expanded_args.push_back(arg.expand(env, shell()));
         }
         std::string expanded_output;
         OutputFormat of(_fmt, expanded_args);
@@ -151,7 +151,17 @@ namespace plux
 
     LineRes LineMatch::run(ShellCtx& ctx, ShellEnv& env)
     {
-        ShellCtx::line_it it(ctx.line_begin());
+        if (ctx.line_matched()) {
+            // matched as the line was read from the shell.
+            ctx.line_consume_until(ctx.line_begin() + ctx.line_cursor() + 1);
+            return LineRes(RES_OK);
+        }
+
+        // lines before the cursor were checked by earlier calls for
+        // this match, only test lines that arrived since.
+        size_t num_lines = ctx.line_end() - ctx.line_begin();
+        ShellCtx::line_it it(ctx.line_begin()
+                             + std::min(ctx.line_cursor(), num_lines));
         for (; it != ctx.line_end(); ++it) {
             if (match(env, ctx.name(), *it, true)) {
                 // match on complete line, consume all lines until
@@ -160,6 +170,8 @@ namespace plux
                 return LineRes(RES_OK);
             }
         }
+        ctx.set_line_cursor(num_lines);
+        arm(ctx, env);
 
         if (match(env, ctx.name(), ctx.buf(), false)) {
             // match on current buffer (no newline), consume all
@@ -172,6 +184,48 @@ namespace plux
         return LineRes(RES_NO_MATCH);
     }
 
+    void LineMatch::arm(ShellCtx& ctx, ShellEnv& env)
+    {
+        ctx.set_line_match(pattern(), nullptr);
+    }
+
+    /**
+     * Expand pattern, the expansion is kept and reused until the
+     * shell, function scope or any of the variables referenced in
+     * the pattern change. changed is set if the pattern was expanded
+     * again.
+     */
+    const std::string& LineMatch::expand_pattern(const ShellEnv& env,
+                                                 const std::string& shell,
+                                                 bool& changed)
+    {
+        if (_pattern.is_literal()) {
+            changed = ! _expanded_valid;
+            _expanded_valid = true;
+            return _pattern.str();
+        }
+
+        uint64_t scope = env.scope();
+        uint64_t version = _pattern.version(env);
+        changed = ! _expanded_valid
+            || scope != _expanded_scope
+            || version != _expanded_version
+            || shell != _expanded_shell;
+        if (changed) {
+            _expanded_valid = false;
+            const std::string& expanded =
+                _pattern.expand(env, shell, _expanded);
+            if (&expanded != &_expanded) {
+                _expanded = expanded;
+            }
+            _expanded_shell = shell;
+            _expanded_scope = scope;
+            _expanded_version = version;
+            _expanded_valid = true;
+        }
+        return _expanded;
+    }
+
     std::string LineExactMatch::to_string(void) const
     {
         return std::string("LineExactMatch ") + pattern();
@@ -191,10 +245,18 @@ namespace plux
     bool LineVarMatch::match(ShellEnv& env, const std::string& shell,
                              const std::string& line, bool is_line)
     {
-        std::string exp_pattern = expand_var(env, shell, pattern());
+        bool changed;
+        const std::string& exp_pattern = expand_pattern(env, shell, changed);
         return line.find(exp_pattern) != std::string::npos;
     }
 
+    void LineVarMatch::arm(ShellCtx& ctx, ShellEnv& env)
+    {
+        bool changed;
+        ctx.set_line_match(expand_pattern(env, ctx.name(), changed),
+                           nullptr);
+    }
+
     std::string LineRegexMatch::to_string(void) const
     {
         return std::string("LineRegexMatch ") + pattern();
@@ -203,14 +265,14 @@ namespace plux
     std::string LineRegexMatch::to_string(ShellEnv& env,
                                           const std::string& shell) const
     {
-        std::string exp_pattern = expand_var(env, shell, pattern());
-        return std::string("?") + exp_pattern;
+        std::string buf;
+        return std::string("?") + expand_pattern(env, shell, buf);
     }
 
     bool LineRegexMatch::match(ShellEnv& env, const std::string& shell,
                                const std::string& line, bool is_line)
     {
-        std::string exp_pattern = expand_var(env, shell, pattern());
+        const std::string& exp_pattern = compile(env, shell);
 
         // pattern has end-of-line anchor $ but the provided line
         // is incomplete, this pattern can not match.
@@ -218,10 +280,13 @@ namespace plux
             return false;
         }
 
+        if (_is_literal) {
+            return line.find(exp_pattern) != std::string::npos;
+        }
+
         try {
-            plux::regex re(exp_pattern);
             plux::smatch matches;
-            if (plux::regex_search(line, matches, re)) {
+            if (plux::regex_search(line, matches, *_re)) {
                 for (size_t i = 1; i < matches.size(); i++) {
                     env.set_env(shell, std::to_string(i), VAR_SCOPE_SHELL,
                                 matches[i].str());
@@ -237,6 +302,85 @@ namespace plux
         }
     }
 
+    /**
+     * Arm with the expanded pattern and its compiled regex, lines are
+     * tested as read without the function scope of this task.
+     */
+    void LineRegexMatch::arm(ShellCtx& ctx, ShellEnv& env)
+    {
+        const std::string& exp_pattern = compile(env, ctx.name());
+        if (_is_literal) {
+            ctx.set_line_match(exp_pattern, nullptr);
+        } else {
+            ctx.set_line_match(exp_pattern, _re);
+        }
+    }
+
+    /**
+     * Expand pattern and compile it unless literal, returns the
+     * expanded pattern.
+     */
+    const std::string& LineRegexMatch::compile(ShellEnv& env,
+                                               const std::string& shell)
+    {
+        bool changed;
+        const std::string& exp_pattern = expand_pattern(env, shell, changed);
+        if (changed) {
+            _is_literal = plux::regex_is_literal(exp_pattern);
+            _re.reset();
+        }
+        if (_is_literal || _re) {
+            return exp_pattern;
+        }
+
+        try {
+            _re = plux::regex_cache().get(exp_pattern);
+        } catch (const plux::regex_error& ex) {
+            std::string msg("regex failed: ");
+            msg += ex.what();
+            throw ScriptError(shell, msg);
+        }
+        return exp_pattern;
+    }
+
+    LineParallel::~LineParallel(void)
+    {
+        for (auto& branch : _branches) {
+            for (auto it : branch.second) {
+                delete it;
+            }
+        }
+    }
+
+    /**
+     * Add line to shell, shells are run in order of first line added.
+     */
+    void LineParallel::line_add(const std::string& shell, Line* line)
+    {
+        auto it = _branches.begin();
+        for (; it != _branches.end(); ++it) {
+            if (it->first == shell) {
+                it->second.push_back(line);
+                return;
+            }
+        }
+        _branches.push_back(std::make_pair(shell, line_vector({line})));
+    }
+
+    LineRes LineParallel::run(ShellCtx& ctx, ShellEnv& env)
+    {
+        return LineRes(RES_PARALLEL);
+    }
+
+    std::string LineParallel::to_string(void) const
+    {
+        std::string str("LineParallel");
+        for (auto& branch : _branches) {
+            str += " " + branch.first;
+        }
+        return str;
+    }
+
     Script::Script(const std::string& file, ScriptEnv& env)
         : _file(file),
           _env(env),
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "output_format.hh"
+#include "regex.hh"
 #include "shell_ctx.hh"
 #include "script_env.hh"
 
@@ -55,12 +56,22 @@ namespace plux
         }
         virtual ~VarAssign(void) { }
 
-        const std::string& key(void) const { return _key; }
-        const std::string& val(void) const { return _val; }
+        const std::string& key(void) const { return _key.str(); }
+        const std::string& val(void) const { return _val.str(); }
+
+    protected:
+        std::string expand_key(const ShellEnv& env,
+                               const std::string& shell) const {
+            return _key.expand(env, shell);
+        }
+        std::string expand_val(const ShellEnv& env,
+                               const std::string& shell) const {
+            return _val.expand(env, shell);
+        }
 
     private:
-        std::string _key;
-        std::string _val;
+        VarTemplate _key;
+        VarTemplate _val;
     };
 
     /**
@@ -92,13 +103,19 @@ namespace plux
         }
         virtual ~LineProgress(void) { }
 
-        const std::string& msg(void) const { return _msg; }
+        const std::string& msg(void) const { return _msg.str(); }
 
         virtual LineRes run(ShellCtx& ctx, ShellEnv& env) override;
         virtual std::string to_string(void) const override;
 
+    protected:
+        std::string expand_msg(const ShellEnv& env,
+                               const std::string& shell) const {
+            return _msg.expand(env, shell);
+        }
+
     private:
-        std::string _msg;
+        VarTemplate _msg;
     };
 
     class LineLog : public LineProgress {
@@ -128,24 +145,18 @@ namespace plux
                  const std::vector<std::string>& args)
             : Line(file, line, shell),
               _name(name),
-              _args(args)
+              _args(args.begin(), args.end())
         {
         }
         virtual ~LineCall(void) { }
 
-        const std::string& name(void) const { return _name; }
+        const std::string& name(void) const { return _name.str(); }
         size_t num_args(void) const { return _args.size(); }
         const std::string& arg(size_t idx) const {
             if (idx >= _args.size()) {
                 return plux::empty_string;
             }
-            return _args[idx];
-        }
-        const std::vector<std::string>::const_iterator args_begin(void) const {
-            return _args.begin();
-        }
-        const std::vector<std::string>::const_iterator args_end(void) const {
-            return _args.end();
+            return _args[idx].str();
         }
 
         virtual LineRes run(ShellCtx& ctx, ShellEnv& env) override;
@@ -153,9 +164,9 @@ namespace plux
 
     private:
         /** Function name, supports variable expansion. */
-        std::string _name;
+        VarTemplate _name;
         /** Argument vector, supports variable expansion. */
-        std::vector<std::string> _args;
+        std::vector<VarTemplate> _args;
     };
 
     /**
@@ -172,15 +183,17 @@ namespace plux
         }
         ~LineSetErrorPattern(void) { }
 
-        const std::string& pattern(void) const { return _pattern; }
-        void set_pattern(const std::string& pattern) { _pattern = pattern; }
+        const std::string& pattern(void) const { return _pattern.str(); }
+        void set_pattern(const std::string& pattern) {
+            _pattern = VarTemplate(pattern);
+        }
 
         virtual LineRes run(ShellCtx& ctx, ShellEnv& env) override;
         virtual std::string to_string(void) const override;
 
     private:
         /** Error pattern. */
-        std::string _pattern;
+        VarTemplate _pattern;
     };
 
     /**
@@ -215,14 +228,16 @@ namespace plux
         }
         virtual ~LineOutput(void) { }
 
-        const std::string& output(void) const { return _output; }
-        void set_output(const std::string& output) { _output = output; }
+        const std::string& output(void) const { return _output.str(); }
+        void set_output(const std::string& output) {
+            _output = VarTemplate(output);
+        }
 
         virtual LineRes run(ShellCtx& ctx, ShellEnv& env) override;
         virtual std::string to_string(void) const override;
 
     private:
-        std::string _output;
+        VarTemplate _output;
     };
 
     /**
@@ -235,7 +250,8 @@ namespace plux
                          const OutputFormat::string_vector args)
             : Line(file, line, shell),
               _fmt(fmt),
-              _args(args)
+              _args(args),
+              _arg_templates(args.begin(), args.end())
         {
         }
         virtual ~LineOutputFormat() { }
@@ -243,7 +259,11 @@ namespace plux
         const std::string& fmt() const { return _fmt; }
         void set_fmt(const std::string& fmt) { _fmt = fmt; }
         const OutputFormat::string_vector& args() const { return _args; }
-        void set_args(const OutputFormat::string_vector& args) { _args = args; }
+        void set_args(const OutputFormat::string_vector& args) {
+            _args = args;
+            _arg_templates = std::vector<VarTemplate>(args.begin(),
+                                                      args.end());
+        }
 
         virtual LineRes run(ShellCtx& ctx, ShellEnv& env) override;
         virtual std::string to_string() const override;
@@ -251,6 +271,8 @@ namespace plux
     private:
         std::string _fmt;
         OutputFormat::string_vector _args;
+        /** Compiled args, supports variable expansion. */
+        std::vector<VarTemplate> _arg_templates;
     };
 
     /**
@@ -285,23 +307,52 @@ namespace plux
         LineMatch(const std::string& file, unsigned int line,
                   const std::string& shell, const std::string& pattern)
             : Line(file, line, shell),
-              _pattern(pattern)
+              _pattern(pattern),
+              _expanded_valid(false),
+              _expanded_scope(0),
+              _expanded_version(0)
         {
         }
         virtual ~LineMatch(void) { }
 
-        const std::string& pattern(void) const { return _pattern; }
-        void set_pattern(const std::string& pattern) { _pattern = pattern; }
+        const std::string& pattern(void) const { return _pattern.str(); }
+        void set_pattern(const std::string& pattern) {
+            _pattern = VarTemplate(pattern);
+            _expanded_valid = false;
+        }
 
         virtual LineRes run(ShellCtx& ctx, ShellEnv& env) override;
 
     protected:
         virtual bool match(ShellEnv& env, const std::string& shell,
                            const std::string& line, bool partial) = 0;
+        /** Set as pending match on ctx, the pattern is expanded in the
+         *  current scope. Matches the pattern as is by default. */
+        virtual void arm(ShellCtx& ctx, ShellEnv& env);
+
+        /** Expand pattern into buf, returns buf or the pattern if it
+         *  has no variables. */
+        const std::string& expand_pattern(const ShellEnv& env,
+                                          const std::string& shell,
+                                          std::string& buf) const {
+            return _pattern.expand(env, shell, buf);
+        }
+        const std::string& expand_pattern(const ShellEnv& env,
+                                          const std::string& shell,
+                                          bool& changed);
 
     private:
         /** Match pattern (string, regex etc) */
-        std::string _pattern;
+        VarTemplate _pattern;
+
+        /** Set if _expanded is the pattern expanded in _expanded_shell,
+         *  function scope _expanded_scope and variable version
+         *  _expanded_version. */
+        bool _expanded_valid;
+        std::string _expanded;
+        std::string _expanded_shell;
+        uint64_t _expanded_scope;
+        uint64_t _expanded_version;
     };
 
     /**
@@ -332,6 +383,7 @@ namespace plux
     protected:
         virtual bool match(ShellEnv& env, const std::string& shell,
                            const std::string& line, bool is_line) override;
+        virtual void arm(ShellCtx& ctx, ShellEnv& env) override;
     };
 
     /**
@@ -339,7 +391,12 @@ namespace plux
      */
     class LineRegexMatch : public LineMatch {
     public:
-        using LineMatch::LineMatch;
+        LineRegexMatch(const std::string& file, unsigned int line,
+                       const std::string& shell, const std::string& pattern)
+            : LineMatch(file, line, shell, pattern),
+              _is_literal(false)
+        {
+        }
         virtual ~LineRegexMatch(void) { }
 
         virtual std::string to_string(void) const override;
@@ -348,7 +405,44 @@ namespace plux
 
     protected:
         virtual bool match(ShellEnv& env, const std::string& shell,
-                           const std::string& line, bool is_line) override ;
+                           const std::string& line, bool is_line) override;
+        virtual void arm(ShellCtx& ctx, ShellEnv& env) override;
+
+    private:
+        const std::string& compile(ShellEnv& env, const std::string& shell);
+
+        /** Expanded pattern has no special characters. */
+        bool _is_literal;
+        /** Compiled expanded pattern, nullptr until first needed. */
+        RegexCache::regex_ptr _re;
+    };
+
+    /**
+     * [parallel] section, the lines of each shell in the section are
+     * run concurrently.
+     */
+    class LineParallel : public Line {
+    public:
+        typedef std::vector<std::pair<std::string, line_vector>> branch_vector;
+        typedef branch_vector::const_iterator branch_it;
+
+        LineParallel(const std::string& file, unsigned int line,
+                     const std::string& shell)
+            : Line(file, line, shell)
+        {
+        }
+        virtual ~LineParallel(void);
+
+        branch_it branch_begin(void) const { return _branches.begin(); }
+        branch_it branch_end(void) const { return _branches.end(); }
+        void line_add(const std::string& shell, Line* line);
+
+        virtual LineRes run(ShellCtx& ctx, ShellEnv& env) override;
+        virtual std::string to_string(void) const override;
+
+    private:
+        /** shell name and lines, in order of first appearance. */
+        branch_vector _branches;
     };
 
     /**
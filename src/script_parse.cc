@@ -82,6 +82,8 @@ namespace plux
                 } else if (ctx.starts_with("[cleanup]")) {
                    state = PARSE_STATE_CLEANUP;
                    ctx.shell = "cleanup";
+                } else if (ctx.starts_with("[parallel]")) {
+                    script->line_add(parse_parallel(ctx, *script));
                 } else {
                     line_cmd = parse_line_cmd(ctx);
                     if (line_cmd) {
@@ -355,6 +357,43 @@ namespace plux
         return nullptr;
     }
 
+    /**
+     * Parse [parallel] section, each [shell name] or [process name]
+     * inside of the section starts the lines of a shell run
+     * concurrently with the other shells until [endparallel].
+     */
+    Line* ScriptParse::parse_parallel(const ScriptParseCtx& ctx,
+                                      Script& script)
+    {
+        std::unique_ptr<LineParallel> parallel(
+            new LineParallel(_path, _linenumber, ctx.shell));
+        ScriptParseCtx parallel_ctx;
+        while (next_line(parallel_ctx)) {
+            if (parallel_ctx.starts_with("[endparallel]")) {
+                if (parallel->branch_begin() == parallel->branch_end()) {
+                    parse_error(parallel_ctx.line,
+                                "no shell lines in [parallel]");
+                }
+                return parallel.release();
+            }
+
+            if (parse_shell(parallel_ctx, parallel_ctx.shell)
+                || parse_process(parallel_ctx, parallel_ctx.shell,
+                                 parallel_ctx.process_args)) {
+                set_parse_state_shell(parallel_ctx, script);
+            } else if (parallel_ctx.shell.empty()) {
+                parse_error(parallel_ctx.line,
+                            "unexpected content, expected [shell name]");
+            } else {
+                auto line_cmd = parse_line_cmd(parallel_ctx);
+                parallel->line_add(parallel_ctx.shell, line_cmd);
+            }
+        }
+
+        parse_error("", "EOF while scanning for [endparallel]");
+        return nullptr;
+    }
+
     Macro* ScriptParse::parse_macro(const ScriptParseCtx& ctx)
     {
         parse_error(ctx.line, "not implemented");
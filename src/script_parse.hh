@@ -96,6 +96,7 @@ namespace plux
         Line* parse_log(const ScriptParseCtx& ctx);
 
         Function* parse_function(const ScriptParseCtx& ctx);
+        Line* parse_parallel(const ScriptParseCtx& ctx, Script& script);
         Macro* parse_macro(const ScriptParseCtx& ctx);
 
         void parse_args(const ScriptParseCtx& ctx, std::string::size_type start,
@@ -5,21 +5,17 @@
 extern "C" {
 #include <sys/wait.h>
 #include <errno.h>
-#include <poll.h>
 #include <unistd.h>
 }
 
 #include "os.hh"
 #include "stdlib_builtins.hh"
 #include "process.hh"
+#include "regex.hh"
 #include "script.hh"
 #include "script_parse.hh"
 #include "script_run.hh"
 
-#ifndef INFTIM
-#define INFTIM -1
-#endif // !INFTIM
-
 namespace plux
 {
     ScriptException::ScriptException(const std::string& error) throw()
@@ -32,104 +28,86 @@ namespace plux
     }
 
     ShellEnvImpl::ShellEnvImpl(const env_map& os_env)
-        : _os_env(os_env)
+        : _os_env(os_env),
+          _version(0)
     {
         // override local shell settings, could render PS1 setting inactive
         _os_env["ENV"] = "/dev/null";
         // set PS1, used in scripts to match the prompt in a consistent manner
         _os_env["PS1"] = "SH-PROMPT:";
-    }
-
-    ShellEnvImpl::~ShellEnvImpl(void) { }
-
-    bool ShellEnvImpl::get_env(const std::string& shell,
-                               const std::string& key,
-                               std::string& val_ret) const
-    {
-        return get_env_function(shell, key, val_ret)
-            || get_env_shell(shell, key, val_ret)
-            || get_env_global(key, val_ret);
-    }
 
-    bool ShellEnvImpl::get_env_global(const std::string& key,
-                                      std::string& val_ret) const
-    {
-        env_map_const_it it;
-        if ((it = _global.find(key)) != _global.end()) {
-            val_ret = it->second;
-            return true;
-        }
-        if ((it = _os_env.find(key)) != _os_env.end()) {
-            val_ret = it->second;
-            return true;
+        VarNames& names = var_names();
+        for (auto& it : plux::default_env) {
+            _os_default.set(names.intern(it.first), it.second);
         }
-        if ((it = plux::default_env.find(key)) != default_env.end()) {
-            val_ret = it->second;
-            return true;
+        for (auto& it : _os_env) {
+            _os_default.set(names.intern(it.first), it.second);
         }
-        return false;
+        build_envp();
     }
 
-    bool ShellEnvImpl::get_env_shell(const std::string& shell,
-                                     const std::string& key,
-                                     std::string& val_ret) const
-    {
-        return get_var(_shell, shell, key, val_ret);
-    }
+    ShellEnvImpl::~ShellEnvImpl(void) { }
 
-    bool ShellEnvImpl::get_env_function(const std::string& shell,
-                                        const std::string& key,
-                                        std::string& val_ret) const
+    /**
+     * Look up variable in function, shell and global scope in order,
+     * finally falling back to the OS environment and default_env.
+     */
+    const std::string* ShellEnvImpl::lookup_env(const std::string& shell,
+                                                var_id key) const
     {
-        if (_function.empty()) {
-            return false;
+        const std::string* val;
+        if (! _function.empty()) {
+            const shell_env_map& vars = _function.back().vars;
+            if ((val = get_var(vars, shell, key))
+                || (! shell.empty() && (val = get_var(vars, "", key)))) {
+                return val;
+            }
         }
-        if (get_var(_function.back(), shell, key, val_ret)) {
-            return true;
+        if ((val = get_var(_shell, shell, key))
+            || (val = _global.get(key))) {
+            return val;
         }
-        return get_var(_function.back(), "", key, val_ret);
+        return _os_default.get(key);
     }
 
-    bool ShellEnvImpl::get_var(const shell_env_map& env,
-                               const std::string& shell,
-                               const std::string& key,
-                               std::string& val_ret) const
+    const std::string* ShellEnvImpl::get_var(const shell_env_map& env,
+                                             const std::string& shell,
+                                             var_id key)
     {
-        auto s_it = env.find(shell);
-        if (s_it != env.end()) {
-            auto it(s_it->second.find(key));
-            if (it != s_it->second.end()) {
-                val_ret = it->second;
-                return true;
-            }
+        if (env.empty()) {
+            return nullptr;
+        }
+        auto it = env.find(shell);
+        if (it == env.end()) {
+            return nullptr;
         }
-        return false;
+        return it->second.get(key);
     }
 
-    void ShellEnvImpl::set_env(const std::string& shell,
-                               const std::string& key,
+    void ShellEnvImpl::set_env(const std::string& shell, var_id key,
                                enum var_scope scope, const std::string& val)
     {
         if (scope == VAR_SCOPE_GLOBAL) {
-            _global[key] = val;
+            _global.set(key, val);
         } else if (scope == VAR_SCOPE_SHELL) {
-            auto it = _shell.find(shell);
-            if (it == _shell.end()) {
-                _shell[shell] = env_map();
-            }
-            _shell[shell][key] = val;
+            _shell[shell].set(key, val);
         } else if (scope == VAR_SCOPE_FUNCTION) {
             if (_function.empty()) {
                 throw ScriptException("set function scoped variable with "
                                       "no active function");
             }
-            _function.back()[shell][key] = val;
+            _function.back().vars[shell].set(key, val);
         }
+
+        if (key >= _versions.size()) {
+            _versions.resize(key + 1, 0);
+        }
+        _versions[key] = ++_version;
     }
 
     void ShellEnvImpl::push_function(void)
     {
-        _function.push_back(shell_env_map());
+        _function.push_back(FunctionScope{++_version, shell_env_map()});
     }
 
     void ShellEnvImpl::pop_function(void)
@@ -137,12 +115,44 @@ namespace plux
         _function.pop_back();
     }
 
-    void ShellEnvImpl::set_os_env() const
+    void ShellEnvImpl::swap_function(function_stack& function)
+    {
+        _function.swap(function);
+    }
+
+    const std::string* ShellEnvImpl::os_get(const std::string& key) const
     {
-        env_map_const_it it(os_begin());
-        for (; it != os_end(); ++it) {
-            setenv(it->first.c_str(), it->second.c_str(), 1 /* overwrite */);
+        auto it = _os_env.find(key);
+        return it == _os_env.end() ? nullptr : &it->second;
+    }
+
+    /**
+     * Build environment for execve from _os_env, the strings are
+     * placed in a single block to be referenced by _envp.
+     */
+    void ShellEnvImpl::build_envp(void)
+    {
+        size_t size = 0;
+        for (auto& it : _os_env) {
+            size += it.first.size() + it.second.size() + 2;
+        }
+        _envp_block.clear();
+        _envp_block.reserve(size);
+        for (auto& it : _os_env) {
+            _envp_block += it.first;
+            _envp_block += '=';
+            _envp_block += it.second;
+            _envp_block += '\0';
+        }
+
+        _envp.clear();
+        _envp.reserve(_os_env.size() + 1);
+        char* str = &_envp_block[0];
+        for (auto& it : _os_env) {
+            _envp.push_back(str);
+            str += it.first.size() + it.second.size() + 2;
         }
+        _envp.push_back(nullptr);
     }
 
     env_map_const_it ShellEnvImpl::os_begin() const
@@ -164,11 +174,16 @@ namespace plux
           _log(log),
           _progress_log(progress_log),
           _stop(false),
-          _timeout(plux::default_timeout_ms()),
           _env(env),
-          _script_env(script->env())
+          _shell_pool(log, progress_log, SH, _env),
+          _script_env(script->env()),
+          _poller(mk_poller())
     {
+        _log << "ScriptRun" << "using " << _poller->name()
+             << " for shell input" << LOG_LEVEL_TRACE;
         _scripts.push_back(script);
+        _shell_pool.set_size(plux::default_shell_pool_size());
+        _shell_pool.set_poller(_poller.get());
     }
 
     /**
@@ -176,7 +191,16 @@ namespace plux
      */
     ScriptRun::~ScriptRun(void)
     {
+        for (auto it : _fd_shells) {
+            log_input_stats(it.second);
+        }
+        const RegexCacheStats& re_stats = regex_cache().stats();
+        _log << "ScriptRun" << "regex cache: " << re_stats.hits << " hits, "
+             << re_stats.misses << " misses, " << re_stats.evictions
+             << " evictions" << LOG_LEVEL_DEBUG;
+
         stop();
+        _shell_pool.clear();
 
         for (auto it : _shells) {
             delete it.second;
@@ -192,17 +216,12 @@ namespace plux
     ScriptResult ScriptRun::run(void)
     {
         const Script* script = _scripts.front();
-        return run(script);
-    }
+        _shell_pool.fill();
 
-    ScriptResult ScriptRun::run(const Script* script)
-    {
-        auto res = run_lines(script->header_begin(), script->header_end());
-        if (res.status() == RES_OK) {
-            res = run_lines(script->line_begin(), script->line_end());
-            run_lines(script->cleanup_begin(), script->cleanup_end());
-        }
-        return res;
+        _tasks.clear();
+        _tasks.emplace_back(nullptr, _fun_ctx, _env.function());
+        _tasks.back().frames.push_back(ScriptFrame(script, false));
+        return run_tasks();
     }
 
     /**
@@ -214,92 +233,309 @@ namespace plux
             for (auto it : _shells) {
                 it.second->stop();
             }
+            _shell_pool.clear();
             _stop = true;
         }
     }
 
+    ScriptFrame::ScriptFrame(const Script* script_, bool next_line_)
+        : type(FRAME_SCRIPT),
+          script(script_),
+          fun(nullptr),
+          next_line(next_line_),
+          has_call(false),
+          call_line(nullptr)
+    {
+        set_stage(STAGE_HEADER);
+    }
+
+    ScriptFrame::ScriptFrame(Function* fun_, const std::string& shell_,
+                             bool next_line_)
+        : type(FRAME_FUNCTION),
+          stage(STAGE_LINES),
+          it(fun_->line_begin()),
+          end(fun_->line_end()),
+          script(nullptr),
+          fun(fun_),
+          shell(shell_),
+          next_line(next_line_),
+          has_call(false),
+          call_line(nullptr)
+    {
+    }
+
+    ScriptFrame::ScriptFrame(line_it begin, line_it end_)
+        : type(FRAME_BRANCH),
+          stage(STAGE_LINES),
+          it(begin),
+          end(end_),
+          script(nullptr),
+          fun(nullptr),
+          next_line(false),
+          has_call(false),
+          call_line(nullptr)
+    {
+    }
+
+    /**
+     * Move script frame to the next stage, header, lines and then
+     * cleanup.
+     *
+     * @return false if there are no more stages.
+     */
+    bool ScriptFrame::next_stage(void)
+    {
+        if (type != FRAME_SCRIPT || stage == STAGE_CLEANUP) {
+            return false;
+        }
+        set_stage(stage == STAGE_HEADER ? STAGE_LINES : STAGE_CLEANUP);
+        return true;
+    }
+
+    void ScriptFrame::set_stage(enum frame_stage stage_)
+    {
+        stage = stage_;
+        if (stage == STAGE_HEADER) {
+            it = script->header_begin();
+            end = script->header_end();
+        } else if (stage == STAGE_LINES) {
+            it = script->line_begin();
+            end = script->line_end();
+        } else {
+            it = script->cleanup_begin();
+            end = script->cleanup_end();
+        }
+    }
+
     /**
-     * Run script lines, part of ordinary script or cleanup.
+     * Call function when frame is done, used for functions defined
+     * in builtin includes.
      */
-    ScriptResult ScriptRun::run_lines(line_it it, line_it end)
+    void ScriptFrame::set_call(const FunctionArgs& fargs, const Line* line,
+                               const std::string& shell_)
     {
-        for (; it != end; ++it) {
+        has_call = true;
+        call_fargs = fargs;
+        call_line = line;
+        call_shell = shell_;
+    }
+
+    /**
+     * Run all tasks until the script task is done.
+     *
+     * Tasks are run until they are waiting for input, input from all
+     * shells is then handled in the same wait_for_input call. Each
+     * task has its own timeout and errors are reported on the line
+     * of the task causing the error.
+     */
+    ScriptResult ScriptRun::run_tasks(void)
+    {
+        while (true) {
+            ScriptTask* next_timeout = nullptr;
+            int timeout_ms = 0;
+            bool progress = false;
+
+            auto it = _tasks.begin();
+            while (it != _tasks.end()) {
+                ScriptTask& task = *it;
+                if (! task.is_aborted) {
+                    task_swap(task);
+                    run_task(task);
+                    task_swap(task);
+                }
+
+                if (task.is_aborted || task.is_done()) {
+                    if (task.parent == nullptr) {
+                        ScriptResult res = task.res;
+                        _tasks.clear();
+                        return res;
+                    }
+                    if (! task.is_aborted) {
+                        task_done(task);
+                        // task waiting for this task is earlier in
+                        // the list, run all tasks again.
+                        progress = true;
+                    }
+                    it = _tasks.erase(it);
+                    continue;
+                }
+
+                if (task.is_waiting) {
+                    int task_timeout_ms = task.timeout.get_ms_until_timeout();
+                    if (next_timeout == nullptr
+                        || task_timeout_ms < timeout_ms) {
+                        next_timeout = &task;
+                        timeout_ms = task_timeout_ms;
+                    }
+                }
+                ++it;
+            }
+
+            if (progress || next_timeout == nullptr) {
+                continue;
+            }
+
+            if (timeout_ms == 0) {
+                task_swap(*next_timeout);
+                auto line = *next_timeout->frames.back().it;
+                task_error(*next_timeout,
+                           script_error(LineRes(RES_TIMEOUT), line,
+                                        plux::empty_string,
+                                        next_timeout->shell));
+                task_swap(*next_timeout);
+                continue;
+            }
+
+            line_status status;
+            ScriptTask* error_task = next_timeout;
             try {
-                ScriptResult res = run_line(*it);
-                if (res.status() != RES_OK) {
-                    return res;
+                status = wait_for_input(timeout_ms);
+            } catch (const ShellException& ex) {
+                // attribute error to the task waiting in the shell
+                // matching the error pattern.
+                for (auto& task : _tasks) {
+                    if (task.is_waiting && ! task.is_aborted
+                        && task.shell->name() == ex.shell()) {
+                        error_task = &task;
+                        break;
+                    }
                 }
-            } catch (const PluxException& ex) {
-                std::string info = ex.info();
-                return script_error(LineRes(RES_ERROR), *it, info);
+                task_swap(*error_task);
+                task_exception(*error_task, ex);
+                task_swap(*error_task);
+                continue;
+            }
+
+            if (status != RES_OK) {
+                task_swap(*error_task);
+                auto line = *error_task->frames.back().it;
+                task_error(*error_task,
+                           script_error(LineRes(status), line,
+                                        plux::empty_string,
+                                        error_task->shell));
+                task_swap(*error_task);
             }
         }
-        return ScriptResult();
     }
 
     /**
-     * Run single script line with timeout, including waiting for more
-     * input data.
+     * Run lines of task until a line is waiting for input, the task
+     * is waiting for [parallel] tasks or all lines are run.
      */
-    ScriptResult ScriptRun::run_line(Line* line)
+    void ScriptRun::run_task(ScriptTask& task)
     {
-        if (_stop) {
-            throw ScriptException("stopped");
-        }
-
-        auto line_shell_name = shell_name(_env, line);
-        _log << "ScriptRun" << "run_line " << line_shell_name << " "
-             << line->to_string() << LOG_LEVEL_DEBUG;
+        while (! task.is_done() && task.num_children == 0) {
+            try {
+                if (task.frames.back().is_done()) {
+                    task_frame_done(task);
+                    continue;
+                }
+                if (_stop) {
+                    throw ScriptException("stopped");
+                }
 
-        ShellCtx* shell = get_or_init_shell(line, line_shell_name);
-        _timeout.set_timeout_ms(shell->timeout());
-        _timeout.restart();
+                Line* line = *task.frames.back().it;
+                LineRes lres(RES_OK);
+                auto line_shell_name = shell_name(_env, line);
+                if (task.is_waiting) {
+                    lres = line->run(*task.shell, _env);
+                } else {
+                    _log << "ScriptRun" << "run_line " << line_shell_name
+                         << " " << line->to_string() << LOG_LEVEL_DEBUG;
+
+                    size_t num_frames = task.frames.size();
+                    task.shell = get_or_init_shell(task, line,
+                                                   line_shell_name);
+                    if (task.frames.size() != num_frames) {
+                        // shell init hook called, start line again
+                        // once the hook is done.
+                        continue;
+                    }
+                    task.timeout.set_timeout_ms(task.shell->timeout());
+                    task.timeout.restart();
+                    task.shell->line_match_reset();
+                    lres = line->run(*task.shell, _env);
+                }
 
-        LineRes lres(RES_OK);
-        lres = line->run(*shell, _env);
-        while (lres.status() == RES_NO_MATCH) {
-            int timeout_ms = _timeout.get_ms_until_timeout();
-            if (timeout_ms == 0) {
-                lres = LineRes(RES_TIMEOUT);
-            } else {
-                lres = LineRes(wait_for_input(timeout_ms));
-                if (lres.status() == RES_OK) {
-                    lres = line->run(*shell, _env);
+                task.is_waiting = lres == RES_NO_MATCH;
+                if (task.is_waiting) {
+                    return;
                 }
+                run_line_result(task, line, lres, line_shell_name);
+            } catch (const PluxException& ex) {
+                task_exception(task, ex);
             }
         }
+    }
 
+    /**
+     * Act on result of completed line, run functions, includes and
+     * [parallel] sections requested by the line.
+     */
+    void ScriptRun::run_line_result(ScriptTask& task, Line* line,
+                                    const LineRes& lres,
+                                    const std::string& shell_name)
+    {
         if (lres == RES_CALL) {
-            return run_function(lres.fargs(), line, line_shell_name);
+            run_function(task, lres.fargs(), line, shell_name, true);
         } else if (lres == RES_INCLUDE) {
-            return run_include(line, lres.fargs().fun());
+            run_include(task, line, lres.fargs().fun(), true);
         } else if (lres == RES_SET) {
-            return run_set(line, lres.fargs());
+            auto res = run_set(line, lres.fargs());
+            if (res.status() == RES_OK) {
+                task_next_line(task);
+            } else {
+                task_error(task, res);
+            }
+        } else if (lres == RES_PARALLEL) {
+            run_parallel(task, dynamic_cast<LineParallel*>(line));
         } else if (lres != RES_OK) {
-            return script_error(lres, line, plux::empty_string,
-                                shell);
+            task_error(task, script_error(lres, line, plux::empty_string,
+                                          task.shell));
         } else {
-            return ScriptResult();
+            task_next_line(task);
         }
     }
 
-    ScriptResult ScriptRun::run_function(const FunctionArgs& fargs,
-                                         const Line* line,
-                                         const std::string& shell)
+    /**
+     * Start a task for each shell in a [parallel] section, the
+     * current task continues when all of them are done.
+     */
+    void ScriptRun::run_parallel(ScriptTask& task,
+                                 const LineParallel* parallel)
+    {
+        auto it = parallel->branch_begin();
+        for (; it != parallel->branch_end(); ++it) {
+            _tasks.emplace_back(&task, _fun_ctx, _env.function());
+            _tasks.back().frames.push_back(ScriptFrame(it->second.begin(),
+                                                       it->second.end()));
+            task.num_children++;
+        }
+        if (task.num_children == 0) {
+            task_next_line(task);
+        }
+    }
+
+    /**
+     * Push frame for function, functions not loaded are looked up
+     * in the builtin includes which are run before the function.
+     */
+    void ScriptRun::run_function(ScriptTask& task, const FunctionArgs& fargs,
+                                 const Line* line, const std::string& shell,
+                                 bool next_line, bool allow_builtin)
     {
         auto fun = _script_env.fun_get(fargs.fun());
-        if (fun == nullptr) {
+        if (fun == nullptr && allow_builtin) {
             // function not loaded, look for a builting function
             auto it = builtin_funs.find(fargs.fun());
             if (it != builtin_funs.end()) {
                 std::string filename = _cfg.stdlib_dir() + "/" + it->second;
                 _log << "ScriptRun" << "include builtin " << fargs.fun()
                      << " from " << filename << LOG_LEVEL_TRACE;
-                auto res = run_include(line, filename);
-                if (res.status() != RES_OK) {
-                    return res;
+                if (run_include(task, line, filename, next_line)) {
+                    task.frames.back().set_call(fargs, line, shell);
                 }
-                fun = _script_env.fun_get(fargs.fun());
+                return;
             }
         }
 
@@ -307,14 +543,6 @@ namespace plux
             throw UndefinedException(shell, "function", fargs.fun());
         }
 
-
-        return run_function(fargs, shell, fun);
-    }
-
-    ScriptResult ScriptRun::run_function(const FunctionArgs& fargs,
-                                         const std::string& shell,
-                                         Function* fun)
-    {
         _log << "ScriptRun" << "run_function " << fun->name() << " ("
              << fun->num_args() << ")" << LOG_LEVEL_TRACE;
 
@@ -324,6 +552,7 @@ namespace plux
         }
 
         push_function(fun, shell);
+        task.frames.push_back(ScriptFrame(fun, shell, next_line));
 
         // function arguments provided as global function scoped
         // variables.
@@ -333,48 +562,44 @@ namespace plux
             _env.set_env("", *arg_name_it, VAR_SCOPE_FUNCTION, *arg_val_it);
         }
         _env.set_env("", "FUNCTION_SHELL", VAR_SCOPE_FUNCTION, shell);
-
-        auto it = fun->line_begin();
-        for (; it != fun->line_end(); ++it) {
-            auto res = run_line(*it);
-            if (res.status() != RES_OK) {
-                return res;
-            }
-        }
-
-        pop_function(fun, shell);
-
-        return ScriptResult();
     }
 
-    ScriptResult ScriptRun::run_include(const Line* line,
-                                        const std::string& filename)
+    /**
+     * Parse script and push frame running its header, lines and
+     * cleanup.
+     *
+     * @return true if frame was pushed, false on error.
+     */
+    bool ScriptRun::run_include(ScriptTask& task, const Line* line,
+                                const std::string& filename, bool next_line)
     {
         _log << "ScriptRun" << "run_include " << filename << LOG_LEVEL_TRACE;
 
         std::string full_path = path_join(current_script_path(), filename);
         std::filebuf fb;
         if (! fb.open(full_path, std::ios::in)) {
-            return script_error(LineRes(RES_ERROR), line,
-                                "failed to include: " + filename);
+            task_error(task, script_error(LineRes(RES_ERROR), line,
+                                          "failed to include: " + filename));
+            return false;
         }
 
-        ScriptResult res;
         std::istream is(&fb);
         try {
             ScriptParse script_parse(filename, &is, _script_env);
-            auto script = script_parse.parse();
-            res = run(script.get());
+            _included.push_back(script_parse.parse());
         } catch (ScriptParseError& ex) {
             std::ostringstream oss;
             oss << "parsing of " << ex.path() << " failed at line "
                 << ex.linenumber() << " "
                 << "error: " << ex.error() << " "
                 << "content: " << ex.line();
-            return script_error(LineRes(RES_ERROR), line, oss.str());
+            task_error(task, script_error(LineRes(RES_ERROR), line,
+                                          oss.str()));
+            return false;
         }
-        return res;
 
+        task.frames.push_back(ScriptFrame(_included.back().get(), next_line));
+        return true;
     }
 
     ScriptResult ScriptRun::run_set(const Line* line,
@@ -399,6 +624,135 @@ namespace plux
         return res;
     }
 
+    /**
+     * Current line of task is done, continue with next line.
+     */
+    void ScriptRun::task_next_line(ScriptTask& task)
+    {
+        task.is_waiting = false;
+        ++task.frames.back().it;
+    }
+
+    /**
+     * All lines of the current frame are run, continue with next
+     * stage of the frame or return to the parent frame.
+     */
+    void ScriptRun::task_frame_done(ScriptTask& task)
+    {
+        ScriptFrame& frame = task.frames.back();
+        if (frame.next_stage()) {
+            return;
+        }
+
+        ScriptResult res = frame.res;
+        bool next_line = frame.next_line;
+        bool has_call = frame.has_call;
+        FunctionArgs fargs = frame.call_fargs;
+        const Line* line = frame.call_line;
+        std::string shell = frame.call_shell;
+        task_pop_frame(task);
+
+        if (task.is_done()) {
+            task.res = res;
+        } else if (res.status() != RES_OK) {
+            task_error(task, res);
+        } else if (has_call) {
+            run_function(task, fargs, line, shell, next_line, false);
+        } else if (next_line) {
+            task_next_line(task);
+        }
+    }
+
+    void ScriptRun::task_pop_frame(ScriptTask& task)
+    {
+        ScriptFrame& frame = task.frames.back();
+        if (frame.type == ScriptFrame::FRAME_FUNCTION) {
+            pop_function(frame.fun, frame.shell);
+        }
+        task.frames.pop_back();
+    }
+
+    /**
+     * Unwind task frames on error, the cleanup of scripts that
+     * had their lines started are run before the error is returned.
+     */
+    void ScriptRun::task_error(ScriptTask& task, ScriptResult res)
+    {
+        task.is_waiting = false;
+        while (! task.is_done()) {
+            ScriptFrame& frame = task.frames.back();
+            if (frame.type == ScriptFrame::FRAME_SCRIPT) {
+                if (frame.stage == ScriptFrame::STAGE_LINES) {
+                    frame.res = res;
+                    frame.set_stage(ScriptFrame::STAGE_CLEANUP);
+                    return;
+                } else if (frame.stage == ScriptFrame::STAGE_CLEANUP) {
+                    // errors in cleanup are ignored, skip rest of the
+                    // cleanup and return result of the lines.
+                    frame.it = frame.end;
+                    task_frame_done(task);
+                    return;
+                }
+            }
+            task_pop_frame(task);
+        }
+        task.res = res;
+    }
+
+    /**
+     * Exceptions are reported on the current line of the script or
+     * [parallel] branch, not on lines inside of called functions.
+     */
+    void ScriptRun::task_exception(ScriptTask& task, const PluxException& ex)
+    {
+        auto it = task.frames.rbegin();
+        while (it->type == ScriptFrame::FRAME_FUNCTION) {
+            ++it;
+        }
+        task_error(task, script_error(LineRes(RES_ERROR), *it->it,
+                                      ex.info()));
+    }
+
+    /**
+     * [parallel] task is done, continue parent task when all of its
+     * tasks are done. On error, the other tasks are aborted and the
+     * error is returned in the parent task.
+     */
+    void ScriptRun::task_done(ScriptTask& task)
+    {
+        ScriptTask& parent = *task.parent;
+        parent.num_children--;
+        if (task.res.status() != RES_OK) {
+            task_abort_children(parent);
+            task_swap(parent);
+            task_error(parent, task.res);
+            task_swap(parent);
+        } else if (parent.num_children == 0) {
+            task_next_line(parent);
+        }
+    }
+
+    void ScriptRun::task_abort_children(ScriptTask& task)
+    {
+        for (auto& child : _tasks) {
+            if (child.parent == &task && ! child.is_aborted) {
+                child.is_aborted = true;
+                task_abort_children(child);
+            }
+        }
+        task.num_children = 0;
+    }
+
+    /**
+     * Swap function context and function scoped variables of task
+     * with the current ones, called before and after running task.
+     */
+    void ScriptRun::task_swap(ScriptTask& task)
+    {
+        _fun_ctx.swap(task.fun_ctx);
+        _env.swap_function(task.fun_env);
+    }
+
     /**
      * Wait for input on all active shells and update their buffers
      * for all shells that have data available.
@@ -408,49 +762,62 @@ namespace plux
         _log << "ScriptRun" << "wait for input on " << _shells.size()
              << " shells" << LOG_LEVEL_TRACE;
 
-        int num_fds;
-        std::unique_ptr<struct pollfd[]> fds(mk_fds(num_fds));
-
-        line_status status = wait_for_input_poll(fds.get(), num_fds,
-                                                 timeout_ms);
+        // replace shells taken from the pool only when no input is
+        // ready, keeping startup of new shells off the path of
+        // shells with output to match.
+        line_status status;
+        if (_shell_pool.num_shells() < _shell_pool.size()) {
+            status = wait_for_input_poll(0);
+            if (status == RES_TIMEOUT) {
+                _shell_pool.fill();
+                status = wait_for_input_poll(timeout_ms);
+            }
+        } else {
+            status = wait_for_input_poll(timeout_ms);
+        }
         if (status != RES_OK) {
             return status;
         }
 
-        auto it = _shells.begin();
-        for (size_t i = 0; i < _shells.size(); ++it, i++) {
-            if (fds[i].revents & POLLIN) {
-                char buf[4096];
-                ssize_t nread = read(it->second->fd_input(), buf, sizeof(buf));
-                if (nread == -1) {
-                    _log << "ScriptRun" << "read failed: " << strerror(errno)
-                         << LOG_LEVEL_ERROR;
-                    return RES_ERROR;
-                } else if (nread == 0) {
-                    if (it->second->is_alive()) {
-                        _log.debug("ScriptRun", "empty read from alive shell, "
-                                   "treat as timeout");
-                        return RES_TIMEOUT;
-                    }
-                    _log.debug("ScriptRun", "empty read from dead shell, "
-                               "remove shell");
-                    it = _shells.erase(it);
-                } else {
-                    it->second->output(buf, nread);
+        PollerInput input;
+        while (_poller->next_input(input)) {
+            auto it = _fd_shells.find(input.fd);
+            if (it == _fd_shells.end()) {
+                _shell_pool.output(input.fd, input.data, input.size);
+                continue;
+            }
+
+            ShellCtx* shell = it->second;
+            if (input.size == -1) {
+                _log << "ScriptRun" << "read failed: "
+                     << strerror(input.error) << LOG_LEVEL_ERROR;
+                return RES_ERROR;
+            } else if (input.size == 0) {
+                if (shell->is_alive()) {
+                    _log.debug("ScriptRun", "empty read from alive shell, "
+                               "treat as timeout");
+                    return RES_TIMEOUT;
                 }
+                _log.debug("ScriptRun", "empty read from dead shell, "
+                           "remove shell");
+                log_input_stats(shell);
+                _poller->remove(input.fd);
+                _fd_shells.erase(it);
+                _shells.erase(shell->name());
+            } else {
+                shell->output(input.data, input.size);
             }
         }
 
         return RES_OK;
     }
 
-    line_status ScriptRun::wait_for_input_poll(struct pollfd *fds, int num_fds,
-                                               int timeout_ms)
+    line_status ScriptRun::wait_for_input_poll(int timeout_ms)
     {
         handle_signals();
         line_status res = RES_OK;
         while (res == RES_OK) {
-            int ret = poll(fds, num_fds, timeout_ms);
+            int ret = _poller->wait(timeout_ms);
             if (ret > 0) {
                 return RES_OK;
             }
@@ -459,8 +826,8 @@ namespace plux
                 if (errno == EINTR) {
                     res = handle_signals();
                 } else {
-                    _log << "ScriptRun" << "poll failed: " << strerror(errno)
-                         << LOG_LEVEL_ERROR;
+                    _log << "ScriptRun" << _poller->name() << " failed: "
+                         << strerror(errno) << LOG_LEVEL_ERROR;
                     res = RES_ERROR;
                 }
             } else {
@@ -471,18 +838,20 @@ namespace plux
         return res;
     }
 
-    struct pollfd* ScriptRun::mk_fds(int &num_fds)
+    /**
+     * Log input counters for shell, logged at debug level when the
+     * shell is removed.
+     */
+    void ScriptRun::log_input_stats(ShellCtx* shell)
     {
-        num_fds = _shells.size();
-        struct pollfd *fds = new struct pollfd[num_fds];
-        auto it = _shells.begin();
-        for (int i = 0; it != _shells.end(); ++it) {
-            fds[i].fd = it->second->fd_input();
-            fds[i].events = POLLIN;
-            fds[i].revents = 0;
-            i++;
+        const PollerStats* stats = _poller->stats(shell->fd_input());
+        if (stats == nullptr) {
+            return;
         }
-        return fds;
+        _log << "ScriptRun" << "input " << shell->name() << ": "
+             << stats->bytes << " bytes in " << stats->reads << " reads, "
+             << stats->wakeups << " wakeups, read size "
+             << stats->read_size << LOG_LEVEL_DEBUG;
     }
 
     line_status ScriptRun::handle_signals()
@@ -501,33 +870,50 @@ namespace plux
                     break;
                 }
             }
+            if (it == _shells.end()) {
+                _shell_pool.reap(pid);
+            }
             pid = waitpid(-1, &status, WNOHANG);
         }
         plux::sigchld = false;
         return RES_OK;
     }
 
-    ShellCtx* ScriptRun::get_or_init_shell(Line* line, const std::string& name)
+    ShellCtx* ScriptRun::get_or_init_shell(ScriptTask& task, Line* line,
+                                           const std::string& name)
     {
         auto it = _shells.find(name);
         if (it != _shells.end()) {
             return it->second;
         }
 
-        ShellCtx *shell = init_shell(name);
+        bool is_polled = false;
+        ShellCtx *shell = init_shell(name, is_polled);
         _shells[name] = shell;
+        if (is_polled || _poller->add(shell->fd_input())) {
+            _fd_shells[shell->fd_input()] = shell;
+        } else {
+            _log << "ScriptRun" << "failed to add shell " << name << " to "
+                 << _poller->name() << ": " << strerror(errno)
+                 << LOG_LEVEL_ERROR;
+        }
         _log.trace("ScriptRun", "started new shell " + name);
 
         if (! _shell_hook_init.empty()
             && dynamic_cast<Shell*>(shell) != nullptr) {
             FunctionArgs fargs(_shell_hook_init);
-            run_function(fargs, line, name);
+            run_function(task, fargs, line, name, false);
         }
 
         return shell;
     }
 
-    ShellCtx* ScriptRun::init_shell(const std::string& name)
+    /**
+     * Start process or shell name, taking shells from the pool when
+     * available. is_polled is set if the input of the shell is
+     * already added to the poller.
+     */
+    ShellCtx* ScriptRun::init_shell(const std::string& name, bool& is_polled)
     {
         ShellLog* shell_log = init_shell_log(name);
         std::vector<std::string> args;
@@ -536,10 +922,16 @@ namespace plux
                        + " command " + args[0]);
             return new Process(_log, shell_log, _progress_log, name, args,
                                _env);
-        } else {
-            _log.debug("ScriptRun", "starting new shell " + name);
-            return new Shell(_log, shell_log, _progress_log, name, SH, _env);
         }
+
+        Shell* shell = _shell_pool.take(name, shell_log);
+        if (shell != nullptr) {
+            _log.debug("ScriptRun", "using started shell " + name);
+            is_polled = true;
+            return shell;
+        }
+        _log.debug("ScriptRun", "starting new shell " + name);
+        return new Shell(_log, shell_log, _progress_log, name, SH, _env);
     }
 
     ShellLog* ScriptRun::init_shell_log(const std::string& name)
@@ -603,6 +995,22 @@ namespace plux
             info += ": ";
             info += res.error();
         }
+        if (ctx) {
+            if (ctx->lines_dropped() > 0) {
+                _log << "ScriptRun" << ctx->name() << " dropped "
+                     << std::to_string(ctx->lines_dropped())
+                     << " unmatched lines" << LOG_LEVEL_INFO;
+            }
+            if (ctx->bytes_dropped() > 0) {
+                _log << "ScriptRun" << ctx->name() << " dropped "
+                     << std::to_string(ctx->bytes_dropped())
+                     << " bytes of incomplete lines" << LOG_LEVEL_INFO;
+            }
+            for (auto& output : ctx->line_tail(FAILURE_OUTPUT_LINES)) {
+                _log << "ScriptRun" << ctx->name() << " output: " << output
+                     << LOG_LEVEL_INFO;
+            }
+        }
 
         std::vector<std::string> stack;
         for (auto it : _fun_ctx) {
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <list>
+#include <memory>
+#include <unordered_map>
+
 #include "cfg.hh"
 #include "log.hh"
 #include "plux.hh"
+#include "poller.hh"
 #include "script.hh"
 #include "shell.hh"
+#include "shell_pool.hh"
 #include "timeout.hh"
 
 namespace plux
@@ -63,43 +69,90 @@ namespace plux
         std::vector<std::string> _stack;
     };
 
-    typedef std::map<std::string, env_map> shell_env_map;
+    /** Variables per shell, the empty shell name holds variables not
+     *  bound to a shell. */
+    typedef std::unordered_map<std::string, VarTable> shell_env_map;
+
+    /**
+     * Function scoped variables, id is unique for each function call.
+     */
+    struct FunctionScope {
+        uint64_t id;
+        shell_env_map vars;
+    };
 
     /**
-     * Script environment.
+     * Script environment. Scopes are VarTables indexed by interned
+     * variable name, the OS environment and default_env are merged
+     * into a single table on construction.
+     *
+     * Setting a variable gives it a new version and entering a
+     * function a new scope id, all taken from the same counter.
+     *
+     * The environment passed to execve is built once, on construction.
      */
     class ShellEnvImpl : public ShellEnv {
     public:
+        typedef std::vector<FunctionScope> function_stack;
+
         explicit ShellEnvImpl(const env_map& env);
+        ShellEnvImpl(const ShellEnvImpl& env) = delete;
         virtual ~ShellEnvImpl(void);
 
-        virtual bool get_env(const std::string& shell, const std::string& key,
-                             std::string& val_ret) const override;
-        virtual void set_env(const std::string& shell, const std::string& key,
+        using ShellEnv::set_env;
+
+        virtual const std::string* lookup_env(const std::string& shell,
+                                              var_id key) const override;
+        virtual void set_env(const std::string& shell, var_id key,
                              enum var_scope scope,
                              const std::string& val) override;
 
+        virtual uint64_t version(var_id key) const override
+        {
+            return key < _versions.size() ? _versions[key] : 0;
+        }
+        virtual uint64_t scope(void) const override
+        {
+            return _function.empty() ? 0 : _function.back().id;
+        }
+
         virtual void push_function(void) override;
         virtual void pop_function(void) override;
 
-        void set_os_env() const override;
+        const function_stack& function(void) const { return _function; }
+        void swap_function(function_stack& function);
+
+        virtual char* const* os_envp() const override
+        {
+            return _envp.data();
+        }
+        virtual const std::string* os_get(const std::string& key)
+            const override;
         virtual env_map_const_it os_begin() const override;
         virtual env_map_const_it os_end() const override;
 
     private:
-        bool get_env_global(const std::string& key, std::string& val_ret) const;
-        bool get_env_shell(const std::string& shell, const std::string& key,
-                           std::string& val_ret) const;
-        bool get_env_function(const std::string& shell, const std::string& key,
-                              std::string& val_ret) const;
-        bool get_var(const shell_env_map& env, const std::string& shell,
-                     const std::string& key, std::string& val_ret) const;
+        void build_envp(void);
+        static const std::string* get_var(const shell_env_map& env,
+                                          const std::string& shell,
+                                          var_id key);
 
     private:
+        /** OS environment, not changed after construction. */
         env_map _os_env;
-        env_map _global;
+        /** _os_env as NUL separated KEY=VALUE strings. */
+        std::string _envp_block;
+        /** Pointers into _envp_block, nullptr terminated. */
+        std::vector<char*> _envp;
+        /** OS environment on top of default_env. */
+        VarTable _os_default;
+        VarTable _global;
         shell_env_map _shell;
-        std::vector<shell_env_map> _function;
+        function_stack _function;
+        /** Last version handed out, to set variables and scopes. */
+        uint64_t _version;
+        /** Version of each variable, indexed by id. */
+        std::vector<uint64_t> _versions;
     };
 
     class ScriptFunctionCtx : public FunctionCtx {
@@ -119,6 +172,104 @@ namespace plux
         std::string _shell;
     };
 
+    /**
+     * Lines being run by a ScriptTask, the header, lines and cleanup
+     * of a script, the lines of a function or a [parallel] branch.
+     */
+    class ScriptFrame {
+    public:
+        enum frame_type {
+            FRAME_SCRIPT,
+            FRAME_FUNCTION,
+            FRAME_BRANCH
+        };
+
+        enum frame_stage {
+            STAGE_HEADER,
+            STAGE_LINES,
+            STAGE_CLEANUP
+        };
+
+        ScriptFrame(const Script* script, bool next_line);
+        ScriptFrame(Function* fun, const std::string& shell, bool next_line);
+        ScriptFrame(line_it begin, line_it end);
+
+        bool is_done(void) const { return it == end; }
+        bool next_stage(void);
+        void set_stage(enum frame_stage stage);
+        void set_call(const FunctionArgs& fargs, const Line* line,
+                      const std::string& shell);
+
+        /** Frame type. */
+        enum frame_type type;
+        /** Stage of script frame. */
+        enum frame_stage stage;
+        /** Current line. */
+        line_it it;
+        /** End of lines in current stage. */
+        line_it end;
+        /** Script, set for FRAME_SCRIPT. */
+        const Script* script;
+        /** Function, set for FRAME_FUNCTION. */
+        Function* fun;
+        /** Shell function is called in. */
+        std::string shell;
+        /** Result of script lines, returned after cleanup. */
+        ScriptResult res;
+        /** If true, continue with next line in parent frame when done. */
+        bool next_line;
+        /** If true, call function in call_fargs when done. */
+        bool has_call;
+        FunctionArgs call_fargs;
+        const Line* call_line;
+        std::string call_shell;
+    };
+
+    /**
+     * Resumable instruction stream, a stack of frames run by the
+     * ScriptRun event loop without recursing on the C stack. Each
+     * [parallel] branch is run as a task of its own.
+     */
+    class ScriptTask {
+    public:
+        ScriptTask(ScriptTask* parent,
+                   const std::vector<ScriptFunctionCtx>& fun_ctx,
+                   const ShellEnvImpl::function_stack& fun_env)
+            : parent(parent),
+              fun_ctx(fun_ctx),
+              fun_env(fun_env),
+              shell(nullptr),
+              is_waiting(false),
+              is_aborted(false),
+              num_children(0),
+              timeout(plux::default_timeout_ms())
+        {
+        }
+
+        bool is_done(void) const { return frames.empty(); }
+
+        /** Task waiting for this task, nullptr for the script task. */
+        ScriptTask* parent;
+        /** Frame stack, current frame last. */
+        std::vector<ScriptFrame> frames;
+        /** Function context, swapped in when task is run. */
+        std::vector<ScriptFunctionCtx> fun_ctx;
+        /** Function scoped variables, swapped in when task is run. */
+        ShellEnvImpl::function_stack fun_env;
+        /** Shell current line is run in, set when line is started. */
+        ShellCtx* shell;
+        /** Set to true when current line is waiting for input. */
+        bool is_waiting;
+        /** Set to true when a sibling task failed. */
+        bool is_aborted;
+        /** Number of [parallel] tasks this task is waiting for. */
+        size_t num_children;
+        /** Timeout for current line. */
+        Timeout timeout;
+        /** Result, set when all frames are done. */
+        ScriptResult res;
+    };
+
     class ScriptException : public PluxException {
     public:
         explicit ScriptException(const std::string& error) throw();
@@ -139,6 +290,9 @@ namespace plux
      */
     class ScriptRun {
     public:
+        /** Shell output lines logged with a failing line. */
+        static const size_t FAILURE_OUTPUT_LINES = 10;
+
         ScriptRun(Log& log, ProgressLog& progress_log, const env_map& env,
                   const Script* script, bool tail);
         ~ScriptRun(void);
@@ -147,25 +301,36 @@ namespace plux
         void stop(void);
 
     protected:
-        ScriptResult run_lines(line_it it, line_it end);
-        ScriptResult run_line(Line* line);
-        ScriptResult run_function(const FunctionArgs& fargs, const Line* line,
-                                  const std::string& shell);
-        ScriptResult run_function(const FunctionArgs& fargs,
-                                  const std::string& shell,
-                                  Function* fun);
-        ScriptResult run_include(const Line* line,
-                                 const std::string& filename);
+        ScriptResult run_tasks(void);
+        void run_task(ScriptTask& task);
+        void run_line_result(ScriptTask& task, Line* line,
+                             const LineRes& lres,
+                             const std::string& shell_name);
+        void run_parallel(ScriptTask& task, const LineParallel* parallel);
+        void run_function(ScriptTask& task, const FunctionArgs& fargs,
+                          const Line* line, const std::string& shell,
+                          bool next_line, bool allow_builtin = true);
+        bool run_include(ScriptTask& task, const Line* line,
+                         const std::string& filename, bool next_line);
         ScriptResult run_set(const Line* line, const FunctionArgs& fargs);
 
+        void task_next_line(ScriptTask& task);
+        void task_frame_done(ScriptTask& task);
+        void task_pop_frame(ScriptTask& task);
+        void task_error(ScriptTask& task, ScriptResult res);
+        void task_exception(ScriptTask& task, const PluxException& ex);
+        void task_done(ScriptTask& task);
+        void task_abort_children(ScriptTask& task);
+        void task_swap(ScriptTask& task);
+
         line_status wait_for_input(int timeout_ms);
-        line_status wait_for_input_poll(struct pollfd *fds, int num_fds,
-                                        int timeout_ms);
-        struct pollfd* mk_fds(int &num_fds);
+        line_status wait_for_input_poll(int timeout_ms);
+        void log_input_stats(ShellCtx* shell);
         line_status handle_signals();
 
-        ShellCtx* get_or_init_shell(Line* line, const std::string& name);
-        ShellCtx* init_shell(const std::string& name);
+        ShellCtx* get_or_init_shell(ScriptTask& task, Line* line,
+                                    const std::string& name);
+        ShellCtx* init_shell(const std::string& name, bool& is_polled);
         ShellLog* init_shell_log(const std::string& name);
 
         std::string shell_name(ShellEnv& env, Line* line);
@@ -178,9 +343,6 @@ namespace plux
         ScriptResult script_error(const LineRes& res, const Line* line,
                                   std::string info, ShellCtx *ctx = nullptr);
 
-    private:
-        ScriptResult run(const Script* script);
-
     private:
         /** If set to true, tail shell output */
         bool _tail;
@@ -198,14 +360,22 @@ namespace plux
         /** Vector with all open Shell logs. */
         std::vector<ShellLog*> _shell_logs;
 
-        /** Timeout for current command. */
-        Timeout _timeout;
         /** Shell environment. */
         ShellEnvImpl _env;
+        /** Started shells, ready to be used by init_shell. */
+        ShellPool _shell_pool;
         /** Script environment. */
         ScriptEnv& _script_env;
         /** Script */
         std::vector<const Script*> _scripts;
+        /** Included scripts, kept for the duration of the run. */
+        std::vector<std::unique_ptr<Script>> _included;
+        /** Running tasks, the script task first. */
+        std::list<ScriptTask> _tasks;
+        /** Poller with input file descriptors of all shells. */
+        std::unique_ptr<Poller> _poller;
+        /** Map from input file descriptor to shell. */
+        std::unordered_map<int, ShellCtx*> _fd_shells;
         /** Script Function Context */
         std::vector<ScriptFunctionCtx> _fun_ctx;
 
@@ -27,6 +27,7 @@ extern "C" {
 }
 
 #include "compat.h"
+#include "os.hh"
 #include "shell.hh"
 
 plux::Shell::Shell(Log& log,
@@ -39,6 +40,17 @@ plux::Shell::Shell(Log& log,
                   true /* trim_special */),
       _fd(-1)
 {
+    // everything exec needs, including the error message, is
+    // prepared before forking.
+    std::string path;
+    bool found = os_find_exec(command, _shell_env.os_get("PATH"), path);
+    char* const argv[] = {const_cast<char*>(command.c_str()), nullptr};
+    // run as a shell script if not an executable, as execvp does
+    char* const sh_argv[] = {const_cast<char*>("/bin/sh"),
+                             const_cast<char*>(path.c_str()), nullptr};
+    char* const* envp = _shell_env.os_envp();
+    std::string error("Shell failed to exec shell " + command + ": ");
+
     pid_t pid = forkpty(&_fd, nullptr, nullptr, nullptr);
     if (pid < 0) {
         log_and_throw_strerror("forkpty failed");
@@ -46,11 +58,19 @@ plux::Shell::Shell(Log& log,
 
     set_pid(pid);
     if (pid == 0) {
-        _shell_env.set_os_env();
-        execlp(command.c_str(), command.c_str(), nullptr);
-        _log << "Shell failed to exec shell " << command << ": "
-             << strerror(errno) << LOG_LEVEL_ERROR;
-        exit(1);
+        int err = ENOENT;
+        if (found) {
+            execve(path.c_str(), argv, envp);
+            if (errno == ENOEXEC) {
+                execve(sh_argv[0], sh_argv, envp);
+            }
+            err = errno;
+        }
+        const char* err_str = os_exec_error(err);
+        write(STDOUT_FILENO, error.c_str(), error.size());
+        write(STDOUT_FILENO, err_str, strlen(err_str));
+        write(STDOUT_FILENO, "\n", 1);
+        _exit(1);
     }
 
     int flags = fcntl(_fd, F_GETFL, 0);
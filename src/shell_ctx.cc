@@ -14,4 +14,26 @@ namespace plux
     UndefinedException::~UndefinedException(void) throw()
     {
     }
+
+    /**
+     * Test match on complete line, regex groups are set as shell
+     * variables as for the line waiting for output.
+     */
+    bool ShellMatch::match_line(ShellEnv& env, const std::string& shell,
+                                const std::string& line) const
+    {
+        if (! _re) {
+            return line.find(_pattern) != std::string::npos;
+        }
+
+        plux::smatch matches;
+        if (! plux::regex_search(line, matches, *_re)) {
+            return false;
+        }
+        for (size_t i = 1; i < matches.size(); i++) {
+            env.set_env(shell, std::to_string(i), VAR_SCOPE_SHELL,
+                        matches[i].str());
+        }
+        return true;
+    }
 }
@@ -5,7 +5,10 @@
 #include <sstream>
 #include <vector>
 
+#include "line_store.hh"
 #include "plux.hh"
+#include "regex.hh"
+#include "var_table.hh"
 
 namespace plux
 {
@@ -71,28 +74,106 @@ namespace plux
         ShellEnv() = default;
         virtual ~ShellEnv() = default;
 
-        virtual bool get_env(const std::string& shell, const std::string& key,
-                             std::string& val_ret) const = 0;
-        virtual void set_env(const std::string& shell, const std::string& key,
+        /**
+         * Look up variable, returns nullptr if not set. The pointer
+         * is valid until the scope holding the variable is left,
+         * setting the variable again changes the value it points to.
+         */
+        virtual const std::string* lookup_env(const std::string& shell,
+                                              var_id key) const = 0;
+        virtual void set_env(const std::string& shell, var_id key,
                              enum var_scope scope, const std::string& val) = 0;
 
+        bool get_env(const std::string& shell, const std::string& key,
+                     std::string& val_ret) const
+        {
+            var_id id = var_names().find(key);
+            const std::string* val =
+                id == VarNames::NONE ? nullptr : lookup_env(shell, id);
+            if (val == nullptr) {
+                return false;
+            }
+            val_ret = *val;
+            return true;
+        }
+        void set_env(const std::string& shell, const std::string& key,
+                     enum var_scope scope, const std::string& val)
+        {
+            set_env(shell, var_names().intern(key), scope, val);
+        }
+
+        /**
+         * Version of variable key, increases whenever key is set in
+         * any scope. Together with scope() used to tell if an earlier
+         * lookup of key is still valid.
+         */
+        virtual uint64_t version(var_id key) const = 0;
+        /** Id of the current function scope, 0 outside functions. */
+        virtual uint64_t scope(void) const = 0;
+
         /** Enter a new function scope. */
         virtual void push_function(void) = 0;
         /** Leave a function scope, drop all function scoped variables. */
         virtual void pop_function(void) = 0;
 
-        virtual void set_os_env() const = 0;
+        /** Environment for execve, built from the OS environment in
+         *  the parent so nothing is allocated after fork. */
+        virtual char* const* os_envp() const = 0;
+        /** Look up variable in the OS environment, nullptr if not set. */
+        virtual const std::string* os_get(const std::string& key) const = 0;
         virtual env_map_const_it os_begin() const = 0;
         virtual env_map_const_it os_end() const = 0;
     };
 
+    /**
+     * Match waiting for output on a shell, tested on complete lines as
+     * they are read. The pattern is expanded when the match is armed,
+     * variables resolve in the function scope of the task waiting for
+     * output which is not active when the output is read.
+     */
+    class ShellMatch {
+    public:
+        ShellMatch(void)
+            : _armed(false)
+        {
+        }
+
+        bool armed(void) const { return _armed; }
+        const std::string& pattern(void) const { return _pattern; }
+
+        /** Arm with expanded pattern, substring search if re is nullptr. */
+        void arm(const std::string& pattern,
+                 const RegexCache::regex_ptr& re)
+        {
+            _armed = true;
+            _pattern = pattern;
+            _re = re;
+        }
+        void disarm(void)
+        {
+            _armed = false;
+            _re.reset();
+        }
+
+        bool match_line(ShellEnv& env, const std::string& shell,
+                        const std::string& line) const;
+
+    private:
+        /** Set when the match is waiting for output. */
+        bool _armed;
+        /** Expanded pattern. */
+        std::string _pattern;
+        /** Compiled pattern, nullptr if the pattern is literal. */
+        RegexCache::regex_ptr _re;
+    };
+
     /**
      * Shell context.
      */
     class ShellCtx {
     public:
-        typedef std::vector<std::string> line_vector;
-        typedef line_vector::iterator line_it;
+        typedef LineStore::line_deque line_vector;
+        typedef LineStore::iterator line_it;
 
         explicit ShellCtx() = default;
         virtual ~ShellCtx() = default;
@@ -123,6 +204,28 @@ namespace plux
         virtual line_it line_begin(void) = 0;
         virtual line_it line_end(void) = 0;
         virtual void line_consume_until(line_it it) = 0;
+        /** Last num lines read, including consumed lines still kept
+         *  and the current incomplete line. */
+        virtual std::vector<std::string> line_tail(size_t num) const = 0;
+        /** Number of lines dropped without being matched, see
+         *  LineStore. */
+        virtual uint64_t lines_dropped(void) const = 0;
+        /** Number of bytes dropped from the start of incomplete lines
+         *  over the size limit, see LineStore. */
+        virtual uint64_t bytes_dropped(void) const = 0;
+        /** Number of lines, from line_begin(), already checked by the
+         *  pending match. Reset when lines are consumed. */
+        virtual size_t line_cursor(void) const = 0;
+        virtual void set_line_cursor(size_t cursor) = 0;
+        /** Set match pending on output, lines read after the cursor
+         *  are tested as they arrive until one matches. pattern is
+         *  expanded, re is nullptr for a substring search. */
+        virtual void set_line_match(const std::string& pattern,
+                                    const RegexCache::regex_ptr& re) = 0;
+        /** Line at the cursor is known to match the pending match. */
+        virtual bool line_matched(void) const = 0;
+        /** Clear cursor and pending match, done when a new line starts. */
+        virtual void line_match_reset(void) = 0;
 
         virtual const std::string& buf(void) const = 0;
         virtual void consume_buf(void) = 0;
@@ -0,0 +1,191 @@
+#include <cerrno>
+#include <cstring>
+
+#include "shell_pool.hh"
+
+namespace plux
+{
+    ShellPool::ShellPool(Log& log, ProgressLog& progress_log,
+                         const std::string& command, ShellEnv& shell_env)
+        : _log(log),
+          _progress_log(progress_log),
+          _command(command),
+          _shell_env(shell_env),
+          _poller(nullptr),
+          _size(0)
+    {
+        const std::string* prompt = shell_env.os_get("PS1");
+        if (prompt != nullptr) {
+            _prompt = *prompt;
+        }
+    }
+
+    /**
+     * Stop all shells not taken from the pool.
+     */
+    ShellPool::~ShellPool(void)
+    {
+        clear();
+    }
+
+    /**
+     * Number of shells that have written their prompt.
+     */
+    size_t ShellPool::num_ready(void) const
+    {
+        size_t num = 0;
+        for (auto it : _shells) {
+            if (it->ready) {
+                num++;
+            }
+        }
+        return num;
+    }
+
+    /**
+     * Start shells until the pool has size started shells.
+     */
+    void ShellPool::fill(void)
+    {
+        while (_shells.size() < _size) {
+            PoolShell* pool_shell = new PoolShell();
+            try {
+                pool_shell->shell = new Shell(_log, &pool_shell->shell_log,
+                                              _progress_log, "", _command,
+                                              _shell_env);
+            } catch (const PluxException&) {
+                delete pool_shell;
+                throw;
+            }
+            _log << "ShellPool" << "started shell "
+                 << pool_shell->shell->pid() << LOG_LEVEL_TRACE;
+            _shells.push_back(pool_shell);
+
+            if (_poller != nullptr
+                && ! _poller->add(pool_shell->shell->fd_input())) {
+                _log << "ShellPool" << "failed to add shell "
+                     << pool_shell->shell->pid() << " to "
+                     << _poller->name() << ": " << strerror(errno)
+                     << LOG_LEVEL_ERROR;
+            }
+        }
+    }
+
+    /**
+     * Pass output read from fd to the pooled shell reading from it, a
+     * shell that reached end of file, or failed, is stopped.
+     *
+     * @return true if fd belonged to a shell in the pool, else false.
+     */
+    bool ShellPool::output(int fd, const char* data, ssize_t size)
+    {
+        auto it = _shells.begin();
+        for (; it != _shells.end(); ++it) {
+            if ((*it)->shell->fd_input() == fd) {
+                break;
+            }
+        }
+        if (it == _shells.end()) {
+            return false;
+        }
+
+        PoolShell* pool_shell = *it;
+        if (size <= 0) {
+            _log << "ShellPool" << "shell " << pool_shell->shell->pid()
+                 << " closed before use" << LOG_LEVEL_DEBUG;
+            remove(it);
+            return true;
+        }
+
+        pool_shell->shell->output(data, size);
+        if (! pool_shell->ready && ! _prompt.empty()
+            && pool_shell->shell->buf().find(_prompt) != std::string::npos) {
+            _log << "ShellPool" << "shell " << pool_shell->shell->pid()
+                 << " ready" << LOG_LEVEL_TRACE;
+            pool_shell->ready = true;
+        }
+        return true;
+    }
+
+    /**
+     * Take a shell from the pool, the oldest shell at its prompt or
+     * the oldest shell if none is ready yet. The shell is given name
+     * and shell_log and ownership of the shell is passed to the
+     * caller, its input is left added to the poller.
+     *
+     * @return Shell, nullptr if the pool is empty.
+     */
+    Shell* ShellPool::take(const std::string& name, ShellLog* shell_log)
+    {
+        if (_shells.empty()) {
+            return nullptr;
+        }
+
+        auto it = _shells.begin();
+        for (; it != _shells.end(); ++it) {
+            if ((*it)->ready) {
+                break;
+            }
+        }
+        if (it == _shells.end()) {
+            it = _shells.begin();
+        }
+
+        PoolShell* pool_shell = *it;
+        _shells.erase(it);
+
+        Shell* shell = pool_shell->shell;
+        const std::string& data = pool_shell->shell_log.data();
+        if (! data.empty()) {
+            shell_log->output(data.data(), data.size());
+        }
+        shell->set_name(name);
+        shell->set_shell_log(shell_log);
+        delete pool_shell;
+        return shell;
+    }
+
+    /**
+     * Remove shell with pid from pool, called when a shell exits
+     * before it has been taken.
+     *
+     * @return true if pid belonged to a shell in the pool, else false.
+     */
+    bool ShellPool::reap(pid_t pid)
+    {
+        auto it = _shells.begin();
+        for (; it != _shells.end(); ++it) {
+            if ((*it)->shell->pid() == pid) {
+                _log << "ShellPool" << "shell " << pid
+                     << " exited before use" << LOG_LEVEL_DEBUG;
+                remove(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Stop all shells in the pool.
+     */
+    void ShellPool::clear(void)
+    {
+        while (! _shells.empty()) {
+            remove(_shells.begin());
+        }
+    }
+
+    /**
+     * Stop shell and remove it from the pool and poller.
+     */
+    void ShellPool::remove(pool_shells::iterator it)
+    {
+        PoolShell* pool_shell = *it;
+        _shells.erase(it);
+        if (_poller != nullptr) {
+            _poller->remove(pool_shell->shell->fd_input());
+        }
+        delete pool_shell->shell;
+        delete pool_shell;
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <deque>
+#include <string>
+
+#include "log.hh"
+#include "poller.hh"
+#include "shell.hh"
+#include "shell_log.hh"
+
+namespace plux
+{
+    /**
+     * Pool of started shells, used to hide shell startup latency.
+     *
+     * Shells are started with the script environment applied and are
+     * left to run until taken from the pool. With a poller set, the
+     * output of pooled shells is read along with the output of all
+     * other shells and a shell is ready once it has written its
+     * prompt. The output read is kept and written to the shell log
+     * given when the shell is taken, the prompt is left to be matched
+     * by the script.
+     */
+    class ShellPool {
+    public:
+        ShellPool(Log& log, ProgressLog& progress_log,
+                  const std::string& command, ShellEnv& shell_env);
+        ShellPool(const ShellPool& shell_pool) = delete;
+        ~ShellPool(void);
+
+        size_t size(void) const { return _size; }
+        void set_size(size_t size) { _size = size; }
+        size_t num_shells(void) const { return _shells.size(); }
+        size_t num_ready(void) const;
+        void set_poller(Poller* poller) { _poller = poller; }
+
+        void fill(void);
+        bool output(int fd, const char* data, ssize_t size);
+        Shell* take(const std::string& name, ShellLog* shell_log);
+        bool reap(pid_t pid);
+        void clear(void);
+
+    private:
+        /**
+         * Shell log keeping output until the shell is taken.
+         */
+        class PoolShellLog : public ShellLog {
+        public:
+            PoolShellLog(void) { }
+            virtual ~PoolShellLog(void) { }
+
+            const std::string& data(void) const { return _data; }
+
+            virtual void input(const std::string&) override { }
+            virtual void output(const char* data, ssize_t size) override {
+                _data.append(data, size);
+            }
+
+        private:
+            std::string _data;
+        };
+
+        /**
+         * Started shell and the output read from it.
+         */
+        class PoolShell {
+        public:
+            PoolShell(void)
+                : shell(nullptr),
+                  ready(false)
+            {
+            }
+
+            /** Shell, owned by the pool until taken. */
+            Shell* shell;
+            /** Output read while in the pool. */
+            PoolShellLog shell_log;
+            /** Set when the shell has written its prompt. */
+            bool ready;
+        };
+        typedef std::deque<PoolShell*> pool_shells;
+
+        void remove(pool_shells::iterator it);
+
+        /** Application log. */
+        Log& _log;
+        /** Progress log, given to started shells. */
+        ProgressLog& _progress_log;
+        /** Shell command. */
+        std::string _command;
+        /** Shell environment. */
+        ShellEnv& _shell_env;
+        /** Prompt written by a started shell, PS1. */
+        std::string _prompt;
+        /** Poller pooled shells are added to, can be nullptr. */
+        Poller* _poller;
+
+        /** Number of shells to keep started. */
+        size_t _size;
+        /** Started shells, oldest first. */
+        pool_shells _shells;
+    };
+}
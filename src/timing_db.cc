@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <queue>
+
+#include "timing_db.hh"
+
+namespace plux
+{
+    TimingDb::TimingDb(const std::string& path)
+        : _path(path)
+    {
+    }
+
+    TimingDb::~TimingDb(void)
+    {
+    }
+
+    /**
+     * Load database from file, invalid lines are skipped.
+     *
+     * @return true if the database file could be read, else false.
+     */
+    bool TimingDb::load(void)
+    {
+        std::ifstream is(_path);
+        if (! is.is_open()) {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(is, line)) {
+            size_t sep = line.find(' ');
+            if (sep == 0 || sep == std::string::npos
+                || sep + 1 == line.size()) {
+                continue;
+            }
+            try {
+                uint64_t elapsed_ms = std::stoull(line.substr(0, sep));
+                _elapsed_ms[line.substr(sep + 1)] = elapsed_ms;
+            } catch (std::invalid_argument&) {
+                // skip invalid entry
+            } catch (std::out_of_range&) {
+                // skip invalid entry
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Write database to file, a temporary file is written and renamed
+     * to avoid leaving a truncated database behind.
+     *
+     * @return true if the database was written, else false.
+     */
+    bool TimingDb::save(void) const
+    {
+        std::string tmp_path = _path + ".tmp";
+        {
+            std::ofstream os(tmp_path, std::ios::out | std::ios::trunc);
+            if (! os.is_open()) {
+                return false;
+            }
+            for (auto& it : _elapsed_ms) {
+                os << it.second << " " << it.first << "\n";
+            }
+            os.flush();
+            if (! os.good()) {
+                return false;
+            }
+        }
+        return rename(tmp_path.c_str(), _path.c_str()) == 0;
+    }
+
+    /**
+     * Get elapsed time of last run of file.
+     *
+     * @return true if file has a recorded run, else false.
+     */
+    bool TimingDb::get(const std::string& file, uint64_t& elapsed_ms) const
+    {
+        auto it = _elapsed_ms.find(file);
+        if (it == _elapsed_ms.end()) {
+            return false;
+        }
+        elapsed_ms = it->second;
+        return true;
+    }
+
+    /**
+     * Set elapsed time of last run of file.
+     */
+    void TimingDb::set(const std::string& file, uint64_t elapsed_ms)
+    {
+        _elapsed_ms[file] = elapsed_ms;
+    }
+
+    /**
+     * Get order files should be started in, longest expected duration
+     * first. Files without a recorded duration are started before all
+     * other files as their duration is unknown. Files with equal
+     * duration keep their original order.
+     *
+     * @return Vector with indexes into files.
+     */
+    std::vector<size_t> schedule_longest_first(
+        const std::vector<std::string>& files, const TimingDb& timing_db)
+    {
+        std::vector<std::pair<size_t, uint64_t>> expected;
+        for (size_t i = 0; i < files.size(); i++) {
+            uint64_t elapsed_ms;
+            if (! timing_db.get(files[i], elapsed_ms)) {
+                elapsed_ms = UINT64_MAX;
+            }
+            expected.push_back(std::make_pair(i, elapsed_ms));
+        }
+
+        std::stable_sort(expected.begin(), expected.end(),
+                         [](const std::pair<size_t, uint64_t>& lhs,
+                            const std::pair<size_t, uint64_t>& rhs) {
+                             return lhs.second > rhs.second;
+                         });
+
+        std::vector<size_t> order;
+        for (auto& it : expected) {
+            order.push_back(it.first);
+        }
+        return order;
+    }
+
+    /**
+     * Get files belonging to shard (1 to num_shards) of num_shards.
+     *
+     * Files are sorted by recorded duration, longest first, and path
+     * and then assigned one at a time to the shard with the least
+     * total duration. Files without a recorded duration count with the
+     * average duration of the recorded files. The result only depends
+     * on the set of files and the timing database, so each executor
+     * given the same input computes the same shards without
+     * coordination.
+     *
+     * @return files in shard, in the same order as in files.
+     */
+    std::vector<std::string> shard_files(
+        const std::vector<std::string>& files, const TimingDb& timing_db,
+        size_t shard, size_t num_shards)
+    {
+        std::vector<std::string> shard_files;
+        if (shard < 1 || shard > num_shards) {
+            return shard_files;
+        }
+
+        uint64_t sum_ms = 0;
+        size_t num_known = 0;
+        for (auto& file : files) {
+            uint64_t elapsed_ms;
+            if (timing_db.get(file, elapsed_ms)) {
+                sum_ms += elapsed_ms;
+                num_known++;
+            }
+        }
+        uint64_t default_ms = num_known ? sum_ms / num_known : 0;
+
+        std::vector<std::pair<uint64_t, size_t>> expected;
+        for (size_t i = 0; i < files.size(); i++) {
+            uint64_t elapsed_ms;
+            if (! timing_db.get(files[i], elapsed_ms)) {
+                elapsed_ms = default_ms;
+            }
+            // count each file at least 1ms, spread files without
+            // duration evenly between shards.
+            expected.push_back(std::make_pair(std::max(elapsed_ms,
+                                                       uint64_t(1)), i));
+        }
+        std::sort(expected.begin(), expected.end(),
+                  [&files](const std::pair<uint64_t, size_t>& lhs,
+                           const std::pair<uint64_t, size_t>& rhs) {
+                      if (lhs.first != rhs.first) {
+                          return lhs.first > rhs.first;
+                      }
+                      return files[lhs.second] < files[rhs.second];
+                  });
+
+        // least loaded shard first, lowest index on equal load.
+        typedef std::pair<uint64_t, size_t> shard_load;
+        std::vector<shard_load> load;
+        load.reserve(num_shards);
+        for (size_t i = 0; i < num_shards; i++) {
+            load.push_back(std::make_pair(uint64_t(0), i));
+        }
+        std::priority_queue<shard_load, std::vector<shard_load>,
+                            std::greater<shard_load>>
+            min_load(std::greater<shard_load>(), std::move(load));
+
+        std::vector<bool> in_shard(files.size(), false);
+        for (auto& it : expected) {
+            shard_load min_shard = min_load.top();
+            min_load.pop();
+            in_shard[it.second] = min_shard.second == (shard - 1);
+            min_shard.first += it.first;
+            min_load.push(min_shard);
+        }
+
+        for (size_t i = 0; i < files.size(); i++) {
+            if (in_shard[i]) {
+                shard_files.push_back(files[i]);
+            }
+        }
+        return shard_files;
+    }
+}
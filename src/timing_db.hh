@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace plux
+{
+    /**
+     * On-disk database with the elapsed time of the last run of each
+     * script, used to schedule scripts by expected duration.
+     *
+     * Stored as a text file with one script per line:
+     *
+     *  elapsed_ms path
+     */
+    class TimingDb {
+    public:
+        explicit TimingDb(const std::string& path);
+        ~TimingDb(void);
+
+        const std::string& path(void) const { return _path; }
+        size_t size(void) const { return _elapsed_ms.size(); }
+
+        bool load(void);
+        bool save(void) const;
+
+        bool get(const std::string& file, uint64_t& elapsed_ms) const;
+        void set(const std::string& file, uint64_t elapsed_ms);
+
+    private:
+        /** Path to database file. */
+        std::string _path;
+        /** Map from script path to elapsed time in milliseconds. */
+        std::map<std::string, uint64_t> _elapsed_ms;
+    };
+
+    std::vector<size_t> schedule_longest_first(
+        const std::vector<std::string>& files, const TimingDb& timing_db);
+    std::vector<std::string> shard_files(
+        const std::vector<std::string>& files, const TimingDb& timing_db,
+        size_t shard, size_t num_shards);
+}
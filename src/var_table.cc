@@ -0,0 +1,54 @@
+#include "var_table.hh"
+
+namespace plux
+{
+    /**
+     * Get id for name, allocating a new id if name is not interned.
+     */
+    var_id VarNames::intern(const std::string& name)
+    {
+        auto it = _ids.find(name);
+        if (it != _ids.end()) {
+            return it->second;
+        }
+        var_id id = static_cast<var_id>(_names.size());
+        it = _ids.emplace(name, id).first;
+        _names.push_back(&it->first);
+        return id;
+    }
+
+    /**
+     * Get id for name without interning it, returns NONE if name is
+     * not interned and thus not set in any VarTable.
+     */
+    var_id VarNames::find(const std::string& name) const
+    {
+        auto it = _ids.find(name);
+        if (it == _ids.end()) {
+            return NONE;
+        }
+        return it->second;
+    }
+
+    /**
+     * Names shared by all scripts and shells in the process.
+     */
+    VarNames& var_names(void)
+    {
+        static VarNames names;
+        return names;
+    }
+
+    void VarTable::set(var_id id, const std::string& val)
+    {
+        if (id >= _vals.size()) {
+            _vals.resize(id + 1);
+            _set.resize(id + 1, false);
+        }
+        if (! _set[id]) {
+            _set[id] = true;
+            _size++;
+        }
+        _vals[id] = val;
+    }
+}
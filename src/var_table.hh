@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace plux
+{
+    /**
+     * Interned variable name.
+     */
+    typedef uint32_t var_id;
+
+    /**
+     * Variable names interned to small integer ids, names used in a
+     * script are interned as it is parsed. Ids are handed out in
+     * order starting at 0 and are never released.
+     */
+    class VarNames {
+    public:
+        /** Id returned by find for names not interned. */
+        static const var_id NONE = UINT32_MAX;
+
+        VarNames(void) = default;
+        VarNames(const VarNames& names) = delete;
+
+        var_id intern(const std::string& name);
+        var_id find(const std::string& name) const;
+        const std::string& name(var_id id) const { return *_names[id]; }
+        size_t size(void) const { return _names.size(); }
+
+    private:
+        /** Name to id lookup. */
+        std::unordered_map<std::string, var_id> _ids;
+        /** Id to name, refers to the keys in _ids. */
+        std::vector<const std::string*> _names;
+    };
+
+    VarNames& var_names(void);
+
+    /**
+     * Variables in a single scope indexed by interned id. Ids are
+     * dense so the table is indexed directly, a lookup is a bounds
+     * check and an index. Values are kept in a deque as growing it
+     * does not move the values already stored.
+     */
+    class VarTable {
+    public:
+        VarTable(void)
+            : _size(0)
+        {
+        }
+
+        /**
+         * Get value for id, nullptr if not set. The pointer stays
+         * valid for the lifetime of the table, setting the variable
+         * again changes the value it points to.
+         */
+        const std::string* get(var_id id) const
+        {
+            if (id >= _vals.size() || ! _set[id]) {
+                return nullptr;
+            }
+            return &_vals[id];
+        }
+        void set(var_id id, const std::string& val);
+
+        bool empty(void) const { return _size == 0; }
+        size_t size(void) const { return _size; }
+
+    private:
+        std::deque<std::string> _vals;
+        std::vector<bool> _set;
+        /** Number of set variables. */
+        size_t _size;
+    };
+}
@@ -0,0 +1,181 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "process_base.hh"
+#include "script_run.hh"
+
+/**
+ * Log discarding all messages.
+ */
+class NullLog : public plux::Log {
+public:
+    NullLog()
+        : plux::Log(plux::LOG_LEVEL_ERROR)
+    {
+    }
+    virtual ~NullLog() { }
+
+protected:
+    virtual void write(enum plux::log_level, const std::string&) override { }
+};
+
+/**
+ * ProgressLog discarding all messages.
+ */
+class NullProgressLog : public plux::ProgressLog {
+public:
+    virtual ~NullProgressLog() { }
+
+    virtual void log(const std::string&, const std::string&) override { }
+};
+
+/**
+ * Process without a process, only output is used.
+ */
+class BenchProcess : public plux::ProcessBase {
+public:
+    BenchProcess(plux::Log& log, plux::ShellLog* shell_log,
+                 plux::ProgressLog& progress_log, plux::ShellEnv& env,
+                 bool trim_special = false)
+        : plux::ProcessBase(log, shell_log, progress_log, "bench", "",
+                            env, trim_special)
+    {
+    }
+    virtual ~BenchProcess() { }
+
+    void set_alive(bool alive, int exitstatus) override { }
+    int fd_input() const override { return -1; }
+    int fd_output() const override { return -1; }
+    void stop() override { }
+};
+
+/**
+ * Output splitting as done before scanning for newlines with memchr,
+ * kept as a reference for the numbers.
+ */
+static void output_bytewise(const char* data, ssize_t size, std::string& buf,
+                            plux::ShellCtx::line_vector& lines)
+{
+    for (ssize_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            if (! buf.empty() && buf[buf.size() - 1] == '\r') {
+                buf.erase(buf.size() - 1);
+            }
+            lines.push_back(buf);
+            buf = "";
+        } else {
+            buf += data[i];
+        }
+    }
+}
+
+static std::string mk_data(size_t size, size_t line_len)
+{
+    std::string data;
+    data.reserve(size);
+    while (data.size() < size) {
+        data.append(line_len, 'x');
+        data += "\r\n";
+    }
+    data.resize(size);
+    return data;
+}
+
+static void report(const char* name, size_t size,
+                   std::chrono::steady_clock::time_point start)
+{
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "  " << name << ": " << (size / secs / (1024 * 1024))
+              << " MB/s" << std::endl;
+}
+
+/**
+ * Measure throughput of ProcessBase::output feeding read sized chunks,
+ * lines are consumed as a match would do.
+ *
+ * usage: bench_output [MB] [chunk size]
+ */
+int main(int argc, char* argv[])
+{
+    size_t mb = argc > 1 ? atoi(argv[1]) : 64;
+    size_t chunk = argc > 2 ? atoi(argv[2]) : 4096;
+    size_t size = mb * 1024 * 1024;
+
+    NullLog log;
+    plux::NullShellLog shell_log;
+    NullProgressLog progress_log;
+    plux::env_map os_env;
+    plux::ShellEnvImpl env(os_env);
+
+    for (size_t line_len : {16, 80, 1024}) {
+        std::string data = mk_data(chunk * 16, line_len);
+        std::cout << "line length " << line_len << ", "
+                  << chunk << " byte chunks" << std::endl;
+
+        BenchProcess process(log, &shell_log, progress_log, env);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < size; n += chunk) {
+            size_t off = n % data.size();
+            size_t len = std::min(chunk, data.size() - off);
+            process.output(data.data() + off, len);
+            process.line_consume_until(process.line_end());
+        }
+        report("output", size, start);
+
+        std::string buf;
+        plux::ShellCtx::line_vector lines;
+        start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < size; n += chunk) {
+            size_t off = n % data.size();
+            size_t len = std::min(chunk, data.size() - off);
+            output_bytewise(data.data() + off, len, buf, lines);
+            lines.clear();
+        }
+        report("bytewise", size, start);
+    }
+
+    // escape codes trimmed as done for [shell], without any escape
+    // codes and with colored output.
+    std::string colored;
+    while (colored.size() < chunk * 16) {
+        colored += "\x1b[1;32mOK\x1b[0m test case passed in 12 ms\r\n";
+    }
+    std::string plain = mk_data(chunk * 16, 80);
+    for (auto data : {&plain, &colored}) {
+        std::cout << "trim escape codes, "
+                  << (data == &plain ? "plain" : "colored") << ", "
+                  << chunk << " byte chunks" << std::endl;
+
+        BenchProcess process(log, &shell_log, progress_log, env, true);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < size; n += chunk) {
+            size_t off = n % data->size();
+            size_t len = std::min(chunk, data->size() - off);
+            process.output(data->data() + off, len);
+            process.line_consume_until(process.line_end());
+        }
+        report("output", size, start);
+    }
+
+    // single line without newline, error pattern checked on the
+    // incomplete line after each chunk.
+    std::string data(chunk, 'x');
+    for (auto pattern : {"ERROR: failed", "ERROR: [a-z]+ [0-9]+"}) {
+        std::cout << "incomplete line, error pattern " << pattern
+                  << ", " << chunk << " byte chunks" << std::endl;
+
+        BenchProcess process(log, &shell_log, progress_log, env);
+        process.set_error_pattern(pattern);
+        size_t line_size = size / 64;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < line_size; n += chunk) {
+            process.output(data.data(), chunk);
+        }
+        report("output", line_size, start);
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <regex.h>
+
+#include "regex.hh"
+
+static void report(const char* name, size_t num,
+                   std::chrono::steady_clock::time_point start)
+{
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "  " << name << ": " << (secs * 1e9 / num)
+              << " ns/search" << std::endl;
+}
+
+/**
+ * Compare plux::regex against std::regex and POSIX regex searching
+ * typical shell output lines.
+ *
+ * usage: bench_regex [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    size_t iterations = argc > 1 ? atoi(argv[1]) : 100000;
+
+    std::vector<std::string> lines = {
+        "SH-PROMPT:",
+        "total 48",
+        "-rw-r--r-- 1 user user  1542 Oct 12 10:02 CMakeLists.txt",
+        "== test_regex passed ==",
+        "make[2]: Leaving directory '/home/user/src/plux/_build'",
+        "12345",
+        std::string(200, 'x') + " ERROR: failed with code 3"
+    };
+    // POSIX regex uses the extended syntax, \s and \d are not available
+    std::vector<std::pair<const char*, const char*>> patterns = {
+        {"SH-PROMPT:", "SH-PROMPT:"},
+        {"^[\\s>]*==(.+)==$", "^[[:space:]>]*==(.+)==$"},
+        {"^(\\d+)$", "^([0-9]+)$"},
+        {"ERROR: [a-z]+ [0-9]+", "ERROR: [a-z]+ [0-9]+"},
+        {"(\\w+)=(\\w*)", "([[:alnum:]_]+)=([[:alnum:]_]*)"}
+    };
+
+    size_t num = iterations * lines.size();
+    for (auto& pattern : patterns) {
+        std::cout << "pattern " << pattern.first << std::endl;
+
+        plux::regex plux_re(pattern.first);
+        plux::smatch plux_m;
+        size_t found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            for (auto& line : lines) {
+                found += plux::regex_search(line, plux_m, plux_re);
+            }
+        }
+        report("plux", num, start);
+
+        std::regex std_re(pattern.first);
+        std::smatch std_m;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            for (auto& line : lines) {
+                found += std::regex_search(line, std_m, std_re);
+            }
+        }
+        report("std", num, start);
+
+        regex_t posix_re;
+        regmatch_t posix_m[3];
+        regcomp(&posix_re, pattern.second, REG_EXTENDED);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            for (auto& line : lines) {
+                found += regexec(&posix_re, line.c_str(), 3, posix_m, 0) == 0;
+            }
+        }
+        report("posix", num, start);
+        regfree(&posix_re);
+
+        if (found % 3 != 0) {
+            std::cerr << "match count differs between engines" << std::endl;
+            return 1;
+        }
+    }
+
+    // nested quantifiers, exponential for backtracking engines
+    std::cout << "pattern (a|aa)*b on 28 a" << std::endl;
+    std::string line(28, 'a');
+    plux::regex plux_re("(a|aa)*b");
+    auto start = std::chrono::steady_clock::now();
+    plux::regex_search(line, plux_re);
+    report("plux", 1, start);
+
+    std::regex std_re("(a|aa)*b");
+    start = std::chrono::steady_clock::now();
+    std::regex_search(line, std_re);
+    report("std", 1, start);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "test.hh"
+#include "plux.hh"
+#include "ansi_strip.hh"
+
+class TestAnsiStrip : public TestSuite {
+public:
+    TestAnsiStrip()
+        : TestSuite("AnsiStrip")
+    {
+        register_test("plain",
+                      std::bind(&TestAnsiStrip::test_plain, this));
+        register_test("csi",
+                      std::bind(&TestAnsiStrip::test_csi, this));
+        register_test("osc",
+                      std::bind(&TestAnsiStrip::test_osc, this));
+        register_test("esc",
+                      std::bind(&TestAnsiStrip::test_esc, this));
+        register_test("split",
+                      std::bind(&TestAnsiStrip::test_split, this));
+    }
+
+    void test_plain()
+    {
+        plux::AnsiStrip strip;
+        std::string out("untouched");
+        ASSERT_FALSE("plain", strip.strip("text\n", 5, out));
+        ASSERT_EQUAL("plain", "untouched", out);
+    }
+
+    void test_csi()
+    {
+        ASSERT_EQUAL("sgr", "red text", strip("\x1b[1;31mred\x1b[0m text"));
+        ASSERT_EQUAL("erase line", "ab", strip("a\x1b[2Kb"));
+        ASSERT_EQUAL("private", "ab", strip("a\x1b[?2004hb"));
+        ASSERT_EQUAL("newline ends", "a\nb", strip("a\x1b[1\nb"));
+    }
+
+    void test_osc()
+    {
+        ASSERT_EQUAL("bel", "prompt$ ", strip("\x1b]0;title\x07prompt$ "));
+        ASSERT_EQUAL("st", "link",
+                     strip("\x1b]8;;http://x\x1b\\link\x1b]8;;\x1b\\"));
+        ASSERT_EQUAL("dcs", "ab", strip("a\x1bPq#0\x1b\\b"));
+        ASSERT_EQUAL("unterminated", "a\nb", strip("a\x1b]0;title\nb"));
+        ASSERT_EQUAL("esc in string", "ab", strip("\x1b]0;t\x1b[0mab"));
+    }
+
+    void test_esc()
+    {
+        ASSERT_EQUAL("two byte", "ab", strip("a\x1b=b"));
+        ASSERT_EQUAL("charset", "ab", strip("a\x1b(Bb"));
+        ASSERT_EQUAL("trailing", "a", strip("a\x1b"));
+        ASSERT_EQUAL("control", "a\nb", strip("a\x1b\nb"));
+    }
+
+    void test_split()
+    {
+        plux::AnsiStrip strip;
+        std::string out;
+        ASSERT_TRUE("split", strip.strip("a\x1b", 2, out));
+        ASSERT_EQUAL("split", "a", out);
+        ASSERT_TRUE("split", strip.strip("[3", 2, out));
+        ASSERT_EQUAL("split", "", out);
+        ASSERT_TRUE("split", strip.strip("1mb\n", 4, out));
+        ASSERT_EQUAL("split", "b\n", out);
+
+        // trailing ESC at end of one read, newline in the next
+        ASSERT_TRUE("trailing", strip.strip("c\x1b", 2, out));
+        ASSERT_EQUAL("trailing", "c", out);
+        ASSERT_TRUE("trailing", strip.strip("\n", 1, out));
+        ASSERT_EQUAL("trailing", "\n", out);
+
+        ASSERT_FALSE("ground", strip.strip("d\n", 2, out));
+    }
+
+private:
+    static std::string strip(const std::string& data)
+    {
+        plux::AnsiStrip strip;
+        std::string out;
+        if (! strip.strip(data.c_str(), data.size(), out)) {
+            return data;
+        }
+        return out;
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        TestAnsiStrip test_ansi_strip;
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}
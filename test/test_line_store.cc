@@ -0,0 +1,170 @@
+#include "test.hh"
+#include "plux.hh"
+#include "line_store.hh"
+
+class TestLineStore : public TestSuite {
+public:
+    TestLineStore()
+        : TestSuite("LineStore")
+    {
+        register_test("consume",
+                      std::bind(&TestLineStore::test_consume, this));
+        register_test("tail",
+                      std::bind(&TestLineStore::test_tail, this));
+        register_test("pool",
+                      std::bind(&TestLineStore::test_pool, this));
+        register_test("limits",
+                      std::bind(&TestLineStore::test_limits, this));
+        register_test("keep",
+                      std::bind(&TestLineStore::test_keep, this));
+        register_test("trim_partial",
+                      std::bind(&TestLineStore::test_trim_partial, this));
+    }
+
+    void test_consume()
+    {
+        plux::LineStore lines(2);
+        ASSERT_TRUE("empty", lines.empty());
+        for (int i = 0; i < 5; i++) {
+            lines.push_back(std::to_string(i));
+        }
+        ASSERT_EQUAL("size", 5, lines.size());
+
+        lines.consume_until(lines.begin() + 3);
+        ASSERT_EQUAL("consume", 2, lines.size());
+        ASSERT_EQUAL("consume", "3", *lines.begin());
+
+        lines.push_back("5");
+        lines.consume_until(lines.end());
+        ASSERT_TRUE("consume all", lines.empty());
+        ASSERT_TRUE("consume all", lines.begin() == lines.end());
+
+        lines.clear();
+        ASSERT_TRUE("clear", lines.tail(10).empty());
+    }
+
+    void test_tail()
+    {
+        plux::LineStore lines(2);
+        lines.push_back("a");
+        lines.push_back("b");
+        lines.push_back("c");
+        lines.consume_until(lines.end());
+        lines.push_back("d");
+
+        auto tail = lines.tail(10);
+        ASSERT_EQUAL("history", 3, tail.size());
+        ASSERT_EQUAL("history", "b", tail[0]);
+        ASSERT_EQUAL("history", "d", tail[2]);
+
+        tail = lines.tail(1);
+        ASSERT_EQUAL("last", 1, tail.size());
+        ASSERT_EQUAL("last", "d", tail[0]);
+    }
+
+    void test_pool()
+    {
+        plux::LineStore lines(1);
+        ASSERT_TRUE("empty", lines.take_buffer().empty());
+
+        std::string long_line(256, 'x');
+        lines.push_back(long_line);
+        lines.push_back(long_line);
+        lines.push_back(std::string(plux::LineStore::POOL_MAX_CAPACITY + 1,
+                                    'y'));
+        lines.push_back("last");
+        lines.consume_until(lines.end());
+        // one line kept as history, the too large buffer is freed
+        ASSERT_EQUAL("pooled", 2, lines.pool_size());
+        ASSERT_EQUAL("history", "last", lines.tail(1)[0]);
+
+        std::string buf = lines.take_buffer();
+        ASSERT_TRUE("buffer empty", buf.empty());
+        ASSERT_TRUE("buffer capacity", buf.capacity() >= 256);
+        ASSERT_EQUAL("pooled", 1, lines.pool_size());
+    }
+
+    void test_limits()
+    {
+        plux::LineStore lines(2);
+        lines.set_limits(3, 0);
+        for (int i = 0; i < 5; i++) {
+            lines.push_back(std::to_string(i));
+        }
+        ASSERT_EQUAL("max lines", 3, lines.size());
+        ASSERT_EQUAL("max lines", "2", *lines.begin());
+        ASSERT_EQUAL("dropped", 2, lines.dropped());
+        // dropped lines are kept as history
+        ASSERT_EQUAL("history", "0", lines.tail(10)[0]);
+
+        lines.consume_until(lines.end());
+        ASSERT_EQUAL("consumed bytes", 0, lines.bytes());
+
+        lines.set_limits(0, 10);
+        lines.push_back("aaaa");
+        lines.push_back("bbbb");
+        ASSERT_EQUAL("bytes", 8, lines.bytes());
+        lines.push_back("cccc");
+        ASSERT_EQUAL("max bytes", 2, lines.size());
+        ASSERT_EQUAL("max bytes", "bbbb", *lines.begin());
+        ASSERT_EQUAL("dropped", 3, lines.dropped());
+
+        // newest line is kept even if larger than the limit
+        lines.push_back(std::string(20, 'x'));
+        ASSERT_EQUAL("newest", 1, lines.size());
+        ASSERT_EQUAL("newest", 20, lines.bytes());
+    }
+
+    void test_keep()
+    {
+        plux::LineStore lines(2);
+        lines.set_limits(2, 0);
+        lines.push_back("0");
+        lines.push_back("1");
+        lines.set_keep(1);
+        for (int i = 2; i < 5; i++) {
+            lines.push_back(std::to_string(i));
+        }
+        ASSERT_EQUAL("keep", 4, lines.size());
+        ASSERT_EQUAL("keep", "1", *lines.begin());
+        ASSERT_EQUAL("keep", 1, lines.dropped());
+
+        // keep index follows consumed lines
+        lines.consume_until(lines.begin() + 1);
+        lines.push_back("5");
+        ASSERT_EQUAL("moved", "2", *lines.begin());
+        ASSERT_EQUAL("moved", 4, lines.size());
+
+        lines.set_keep(plux::LineStore::KEEP_NONE);
+        lines.push_back("6");
+        ASSERT_EQUAL("none", 2, lines.size());
+        ASSERT_EQUAL("none", "5", *lines.begin());
+    }
+
+    void test_trim_partial()
+    {
+        plux::LineStore lines;
+        std::string buf(100, 'x');
+        ASSERT_EQUAL("no limit", 0, lines.trim_partial(buf));
+
+        lines.set_limits(0, 10);
+        buf = "0123456789";
+        ASSERT_EQUAL("at limit", 0, lines.trim_partial(buf));
+        buf += "a";
+        ASSERT_EQUAL("over limit", 6, lines.trim_partial(buf));
+        ASSERT_EQUAL("over limit", "6789a", buf);
+        ASSERT_EQUAL("dropped", 6, lines.dropped_bytes());
+        ASSERT_EQUAL("dropped", 0, lines.dropped());
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        TestLineStore test_line_store;
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}
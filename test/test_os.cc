@@ -0,0 +1,67 @@
+#include <cstring>
+
+extern "C" {
+#include <errno.h>
+}
+
+#include "test.hh"
+#include "plux.hh"
+#include "os.hh"
+
+class TestOs : public TestSuite {
+public:
+    TestOs()
+        : TestSuite("Os")
+    {
+        register_test("find_exec",
+                      std::bind(&TestOs::test_find_exec, this));
+        register_test("exec_error",
+                      std::bind(&TestOs::test_exec_error, this));
+    }
+
+    void test_find_exec()
+    {
+        std::string path("/nonexistent:/bin:/usr/bin");
+        std::string exec_path;
+        ASSERT_TRUE("path", plux::os_find_exec("sh", &path, exec_path));
+        ASSERT_EQUAL("path", "/bin/sh", exec_path);
+        ASSERT_TRUE("default path",
+                    plux::os_find_exec("sh", nullptr, exec_path));
+        ASSERT_EQUAL("default path", "/bin/sh", exec_path);
+        ASSERT_TRUE("slash", plux::os_find_exec("./sh", &path, exec_path));
+        ASSERT_EQUAL("slash", "./sh", exec_path);
+
+        // not found, not resolved against the current directory
+        exec_path = "unchanged";
+        ASSERT_FALSE("missing",
+                     plux::os_find_exec("plux-missing", &path, exec_path));
+        ASSERT_EQUAL("missing", "unchanged", exec_path);
+        ASSERT_FALSE("empty", plux::os_find_exec("", &path, exec_path));
+
+        // directories are skipped even if executable
+        std::string dir_path("/:/bin");
+        ASSERT_FALSE("directory",
+                     plux::os_find_exec("usr", &dir_path, exec_path));
+    }
+
+    void test_exec_error()
+    {
+        ASSERT_EQUAL("enoent", strerror(ENOENT),
+                     std::string(plux::os_exec_error(ENOENT)));
+        ASSERT_EQUAL("enoexec", strerror(ENOEXEC),
+                     std::string(plux::os_exec_error(ENOEXEC)));
+        ASSERT_EQUAL("unknown", "exec failed",
+                     std::string(plux::os_exec_error(0)));
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        TestOs test_os;
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}
@@ -8,6 +8,8 @@ public:
     {
         register_test("format_elapsed",
                       std::bind(&TestPlux::test_format_elapsed, this));
+        register_test("elapsed_ms",
+                      std::bind(&TestPlux::test_elapsed_ms, this));
         register_test("path_join", std::bind(&TestPlux::test_path_join, this));
     }
 
@@ -42,6 +44,21 @@ public:
                      plux::format_elapsed(start, end));
     }
 
+    void test_elapsed_ms()
+    {
+        struct timespec start, end;
+        start.tv_sec = 10;
+        start.tv_nsec = 750000000;
+
+        ASSERT_EQUAL("no time", 0, plux::elapsed_ms(start, start));
+
+        end.tv_sec = 12;
+        end.tv_nsec = 250000000;
+        ASSERT_EQUAL("s, ms", 1500, plux::elapsed_ms(start, end));
+
+        ASSERT_EQUAL("negative", 0, plux::elapsed_ms(end, start));
+    }
+
     void test_path_join()
     {
         ASSERT_EQUAL("both empty", "", plux::path_join("", ""));
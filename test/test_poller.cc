@@ -0,0 +1,143 @@
+#include <iostream>
+#include <memory>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+#include "test.hh"
+#include "plux.hh"
+#include "poller.hh"
+
+class TestPoller : public TestSuite {
+public:
+    TestPoller()
+        : TestSuite("poller")
+    {
+        register_test("poll", std::bind(&TestPoller::test_poll, this));
+        register_test("drain", std::bind(&TestPoller::test_drain, this));
+#ifdef HAVE_SYS_EPOLL_H
+        register_test("epoll", std::bind(&TestPoller::test_epoll, this));
+#endif // HAVE_SYS_EPOLL_H
+#ifdef HAVE_IO_URING
+        register_test("io_uring",
+                      std::bind(&TestPoller::test_io_uring, this));
+#endif // HAVE_IO_URING
+    }
+
+    void test_poll()
+    {
+        plux::PollPoller poller;
+        test_poller(poller);
+    }
+
+    void test_drain()
+    {
+        int fds[2];
+        ASSERT_EQUAL("pipe", 0, pipe(fds));
+        int flags = fcntl(fds[0], F_GETFL, 0);
+        ASSERT_EQUAL("fcntl", 0, fcntl(fds[0], F_SETFL, flags | O_NONBLOCK));
+
+        plux::PollPoller poller;
+        ASSERT_TRUE("add", poller.add(fds[0]));
+
+        // 65536 bytes fit in the default pipe buffer
+        std::string data(65536, 'x');
+        ASSERT_EQUAL("write", 65536, write(fds[1], data.c_str(), data.size()));
+
+        // read size doubles from 4096 until the short read of the
+        // remaining 4096 bytes, all in the same wait.
+        plux::PollerInput input;
+        ASSERT_EQUAL("wait", 1, poller.wait(0));
+        ssize_t sizes[] = {4096, 8192, 16384, 32768, 4096};
+        for (auto size : sizes) {
+            ASSERT_TRUE("input", poller.next_input(input));
+            ASSERT_EQUAL("input", size, input.size);
+        }
+        ASSERT_FALSE("drained", poller.next_input(input));
+
+        auto stats = poller.stats(fds[0]);
+        ASSERT_NOT_NULL("stats", stats);
+        ASSERT_EQUAL("wakeups", 1, stats->wakeups);
+        ASSERT_EQUAL("reads", 5, stats->reads);
+        ASSERT_EQUAL("bytes", 65536, stats->bytes);
+        ASSERT_EQUAL("read_size", 32768, stats->read_size);
+
+        poller.remove(fds[0]);
+        ASSERT_TRUE("removed", poller.stats(fds[0]) == nullptr);
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+#ifdef HAVE_SYS_EPOLL_H
+    void test_epoll()
+    {
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        ASSERT_TRUE("epoll_create1", epfd != -1);
+        plux::EpollPoller poller(epfd);
+        test_poller(poller);
+    }
+#endif // HAVE_SYS_EPOLL_H
+
+#ifdef HAVE_IO_URING
+    void test_io_uring()
+    {
+        plux::IoUringPoller poller;
+        if (! poller.init()) {
+            std::cout << "io_uring not available, skipping" << std::endl;
+            return;
+        }
+        test_poller(poller);
+    }
+#endif // HAVE_IO_URING
+
+    void test_poller(plux::Poller& poller)
+    {
+        int fds1[2], fds2[2];
+        ASSERT_EQUAL("pipe", 0, pipe(fds1));
+        ASSERT_EQUAL("pipe", 0, pipe(fds2));
+
+        plux::PollerInput input;
+        ASSERT_TRUE("add", poller.add(fds1[0]));
+        ASSERT_TRUE("add", poller.add(fds2[0]));
+        ASSERT_EQUAL("timeout", 0, poller.wait(0));
+        ASSERT_FALSE("timeout", poller.next_input(input));
+
+        ASSERT_EQUAL("write", 3, write(fds2[1], "abc", 3));
+        ASSERT_TRUE("ready", poller.wait(100) > 0);
+        ASSERT_TRUE("input", poller.next_input(input));
+        ASSERT_EQUAL("input", fds2[0], input.fd);
+        ASSERT_EQUAL("input", "abc", std::string(input.data, input.size));
+        ASSERT_FALSE("input", poller.next_input(input));
+        ASSERT_EQUAL("read", 0, poller.wait(0));
+
+        ASSERT_EQUAL("write", 3, write(fds1[1], "def", 3));
+        ASSERT_TRUE("ready", poller.wait(100) > 0);
+        ASSERT_TRUE("input", poller.next_input(input));
+        ASSERT_EQUAL("input", fds1[0], input.fd);
+        ASSERT_EQUAL("input", "def", std::string(input.data, input.size));
+
+        poller.remove(fds2[0]);
+        ASSERT_EQUAL("write", 1, write(fds2[1], "x", 1));
+        poller.wait(0);
+        ASSERT_FALSE("removed", poller.next_input(input));
+
+        poller.remove(fds1[0]);
+        close(fds1[0]);
+        close(fds1[1]);
+        close(fds2[0]);
+        close(fds2[1]);
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    TestPoller test_poller;
+    try {
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}
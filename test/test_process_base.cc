@@ -0,0 +1,188 @@
+#include "test.hh"
+#include "process_base.hh"
+#include "script_run.hh"
+
+/**
+ * Log discarding all messages.
+ */
+class NullLog : public plux::Log {
+public:
+    NullLog()
+        : plux::Log(plux::LOG_LEVEL_ERROR)
+    {
+    }
+    virtual ~NullLog() { }
+
+protected:
+    virtual void write(enum plux::log_level, const std::string&) override { }
+};
+
+/**
+ * ProgressLog discarding all messages.
+ */
+class NullProgressLog : public plux::ProgressLog {
+public:
+    virtual ~NullProgressLog() { }
+
+    virtual void log(const std::string&, const std::string&) override { }
+};
+
+/**
+ * Process without a process, only output is used.
+ */
+class TestProcess : public plux::ProcessBase {
+public:
+    TestProcess(plux::Log& log, plux::ShellLog* shell_log,
+                plux::ProgressLog& progress_log, plux::ShellEnv& env)
+        : plux::ProcessBase(log, shell_log, progress_log, "test", "",
+                            env, false)
+    {
+    }
+    virtual ~TestProcess() { }
+
+    void set_alive(bool alive, int exitstatus) override { }
+    int fd_input() const override { return -1; }
+    int fd_output() const override { return -1; }
+    void stop() override { }
+
+    void output(const std::string& data)
+    {
+        ProcessBase::output(data.c_str(), data.size());
+    }
+};
+
+class TestProcessBase : public TestSuite {
+public:
+    TestProcessBase()
+        : TestSuite("ProcessBase"),
+          _env(plux::env_map())
+    {
+        register_test("error_pattern",
+                      std::bind(&TestProcessBase::test_error_pattern, this));
+        register_test("error_pattern_invalid",
+                      std::bind(&TestProcessBase::test_error_pattern_invalid,
+                                this));
+        register_test("max_lines_matched",
+                      std::bind(&TestProcessBase::test_max_lines_matched,
+                                this));
+        register_test("max_bytes_partial",
+                      std::bind(&TestProcessBase::test_max_bytes_partial,
+                                this));
+    }
+
+    void test_error_pattern()
+    {
+        TestProcess process(_log, &_shell_log, _progress_log, _env);
+        process.set_error_pattern("fail(ed|ure)");
+        process.output("all good\n");
+        try {
+            process.output("it failed\n");
+            ASSERT_TRUE("matched", false);
+        } catch (plux::ShellException&) {
+        }
+    }
+
+    void test_error_pattern_invalid()
+    {
+        TestProcess process(_log, &_shell_log, _progress_log, _env);
+        try {
+            process.set_error_pattern("abc(");
+            ASSERT_TRUE("invalid", false);
+        } catch (plux::ShellException&) {
+        }
+        ASSERT_EQUAL("invalid, unset", "", process.error_pattern());
+        // output is not checked against the invalid pattern
+        process.output("abc(\n");
+        process.output("partial abc(");
+
+        // previous pattern is kept when setting an invalid pattern
+        process.set_error_pattern("error");
+        try {
+            process.set_error_pattern("abc(");
+            ASSERT_TRUE("invalid", false);
+        } catch (plux::ShellException&) {
+        }
+        ASSERT_EQUAL("invalid, kept", "error", process.error_pattern());
+        try {
+            process.output("\nerror\n");
+            ASSERT_TRUE("kept", false);
+        } catch (plux::ShellException&) {
+        }
+    }
+
+    void test_max_lines_matched()
+    {
+        size_t max_lines = plux::default_max_lines();
+        plux::set_default_max_lines(3);
+        TestProcess process(_log, &_shell_log, _progress_log, _env);
+        plux::set_default_max_lines(max_lines);
+
+        // matched line and the lines after it are kept over the limit
+        process.set_line_match("a", nullptr);
+        process.output("a\nb\nc\nd\ne\nf\n");
+        ASSERT_TRUE("matched", process.line_matched());
+        ASSERT_EQUAL("matched", 0, process.line_cursor());
+        ASSERT_EQUAL("matched", "a", *process.line_begin());
+        ASSERT_EQUAL("matched", 0, process.lines_dropped());
+        process.line_consume_until(process.line_begin() + 1);
+
+        // lines before the matched line are dropped
+        process.set_line_match("x", nullptr);
+        process.set_line_cursor(process.line_end() - process.line_begin());
+        process.output("x\ny\nz\n");
+        ASSERT_TRUE("dropped before", process.line_matched());
+        ASSERT_EQUAL("dropped before", 0, process.line_cursor());
+        ASSERT_EQUAL("dropped before", "x", *process.line_begin());
+        ASSERT_EQUAL("dropped before", 5, process.lines_dropped());
+        process.line_consume_until(process.line_begin() + 1);
+
+        // unmatched lines are dropped again once the match is done
+        process.output("1\n");
+        ASSERT_EQUAL("unmatched", 3,
+                     process.line_end() - process.line_begin());
+    }
+
+    void test_max_bytes_partial()
+    {
+        size_t max_bytes = plux::default_max_bytes();
+        plux::set_default_max_bytes(16);
+        TestProcess process(_log, &_shell_log, _progress_log, _env);
+        plux::set_default_max_bytes(max_bytes);
+        process.set_error_pattern("error");
+
+        // output without newlines is bounded
+        for (int i = 0; i < 100; i++) {
+            process.output("progress\r");
+        }
+        ASSERT_TRUE("bounded", process.buf().size() <= 16);
+        ASSERT_TRUE("dropped", process.bytes_dropped() > 0);
+        ASSERT_EQUAL("dropped", 900 - process.buf().size(),
+                     process.bytes_dropped());
+        ASSERT_EQUAL("dropped", 0, process.lines_dropped());
+
+        // error pattern still checked on the kept bytes
+        try {
+            process.output("err");
+            process.output("or");
+            ASSERT_TRUE("error", false);
+        } catch (plux::ShellException&) {
+        }
+    }
+
+private:
+    NullLog _log;
+    plux::NullShellLog _shell_log;
+    NullProgressLog _progress_log;
+    plux::ShellEnvImpl _env;
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        TestProcessBase test_process_base;
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}
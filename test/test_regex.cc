@@ -2,6 +2,10 @@
 #include "plux.hh"
 #include "regex.hh"
 
+#ifdef USE_NFA_REGEX
+#include <regex>
+#endif // USE_NFA_REGEX
+
 class TestRegex : public TestSuite {
 public:
     TestRegex()
@@ -11,12 +15,28 @@ public:
                       std::bind(&TestRegex::test_match, this));
         register_test("search",
                       std::bind(&TestRegex::test_search, this));
+        register_test("search_reuse",
+                      std::bind(&TestRegex::test_search_reuse, this));
         register_test("search_splus",
                       std::bind(&TestRegex::test_search_splus, this));
         register_test("search_dD",
                       std::bind(&TestRegex::test_search_dD, this));
         register_test("search_wW",
                       std::bind(&TestRegex::test_search_wW, this));
+        register_test("cache",
+                      std::bind(&TestRegex::test_cache, this));
+        register_test("search_pos",
+                      std::bind(&TestRegex::test_search_pos, this));
+        register_test("is_literal",
+                      std::bind(&TestRegex::test_is_literal, this));
+#ifdef USE_NFA_REGEX
+        register_test("nfa_compare",
+                      std::bind(&TestRegex::test_nfa_compare, this));
+        register_test("nfa_linear",
+                      std::bind(&TestRegex::test_nfa_linear, this));
+        register_test("nfa_error",
+                      std::bind(&TestRegex::test_nfa_error, this));
+#endif // USE_NFA_REGEX
     }
 
     void test_match()
@@ -39,6 +59,29 @@ public:
         ASSERT_EQUAL("match[1]", "do-start-xvfb", m[1]);
     }
 
+    void test_search_reuse()
+    {
+        plux::regex re("^(\\w+)=(\\d+)?$");
+        plux::smatch m;
+
+        const std::string line1("key=42");
+        ASSERT_EQUAL("search", true, plux::regex_search(line1, m, re));
+        ASSERT_EQUAL("match count", 3, m.size());
+        ASSERT_EQUAL("match[1]", "key", m[1]);
+        ASSERT_EQUAL("match[2]", 2, m[2].length());
+        ASSERT_EQUAL("match[2]", std::string("42"), m[2].str());
+
+        // same regex and smatch, optional group not part of the match
+        const std::string line2("other=");
+        ASSERT_EQUAL("search", true, plux::regex_search(line2, m, re));
+        ASSERT_EQUAL("match count", 3, m.size());
+        ASSERT_EQUAL("match[1]", "other", m[1]);
+        ASSERT_EQUAL("match[2]", 0, m[2].length());
+        ASSERT_EQUAL("match[2]", std::string(), m[2].str());
+
+        ASSERT_EQUAL("search", false, plux::regex_search("=1", m, re));
+    }
+
     void test_search_splus()
     {
         plux::regex re("XTerm\\*background:\\s+#ffffff");
@@ -80,14 +123,153 @@ public:
         ASSERT_EQUAL("W+", 2, mW.size());
         ASSERT_EQUAL("W+", "!!!", mW[1]);
     }
+
+    void test_cache()
+    {
+        plux::RegexCache cache(2);
+
+        auto re1 = cache.get("a+");
+        ASSERT_EQUAL("miss", 1, cache.stats().misses);
+        ASSERT_TRUE("search", regex_search("baa", *re1));
+        ASSERT_TRUE("hit", re1 == cache.get("a+"));
+        ASSERT_EQUAL("hit", 1, cache.stats().hits);
+
+        // b+ and a+ cached, c+ evicts the least recently used b+
+        cache.get("b+");
+        cache.get("a+");
+        cache.get("c+");
+        ASSERT_EQUAL("size", 2, cache.size());
+        ASSERT_EQUAL("evictions", 1, cache.stats().evictions);
+        ASSERT_TRUE("kept", re1 == cache.get("a+"));
+        cache.get("b+");
+        ASSERT_EQUAL("misses", 4, cache.stats().misses);
+
+        bool error = false;
+        try {
+            cache.get("(");
+        } catch (const plux::regex_error&) {
+            error = true;
+        }
+        ASSERT_TRUE("invalid", error);
+        ASSERT_EQUAL("invalid not cached", 2, cache.size());
+
+        cache.set_capacity(1);
+        ASSERT_EQUAL("shrink", 1, cache.size());
+    }
+
+    void test_search_pos()
+    {
+        const std::string line("error: abc");
+
+        plux::regex re("abc");
+        ASSERT_TRUE("pos 0", plux::regex_search(line, 0, re));
+        ASSERT_TRUE("pos before", plux::regex_search(line, 7, re));
+        ASSERT_FALSE("pos after", plux::regex_search(line, 8, re));
+
+        plux::regex re_bol("^error");
+        ASSERT_TRUE("bol", plux::regex_search(line, 0, re_bol));
+        plux::regex re_bol_abc("^abc");
+        ASSERT_FALSE("not bol", plux::regex_search(line, 7, re_bol_abc));
+    }
+
+    void test_is_literal()
+    {
+        ASSERT_TRUE("literal", plux::regex_is_literal("SH-PROMPT:"));
+        ASSERT_TRUE("literal", plux::regex_is_literal("error: no such file"));
+        ASSERT_FALSE("empty", plux::regex_is_literal(""));
+        ASSERT_FALSE("anchor", plux::regex_is_literal("^done$"));
+        ASSERT_FALSE("group", plux::regex_is_literal("(a)"));
+        ASSERT_FALSE("escape", plux::regex_is_literal("\\d"));
+        ASSERT_FALSE("dot", plux::regex_is_literal("a.b"));
+    }
+
+#ifdef USE_NFA_REGEX
+    /**
+     * Compare search result and sub matches with std::regex.
+     */
+    void test_nfa_compare()
+    {
+        const char* patterns[] = {
+            "a", "abc", "a|b|c", "(a|ab)(c|bcd)(d*)", "x*", "x+?y",
+            "(a+)(a*)", "(a*?)(a*)", "^[\\s>]*==(.+)==$", "^$",
+            "[^a-c]+", "[]a]", "[a\\]]+", "[-a]+", "[a-]+",
+            "\\d+\\.\\d{1,2}", "\\bword\\b", "\\Bor\\B",
+            "a{2,}", "a{2,3}?", "(?:ab)+", "(a)|(b)", "((a)|b)+",
+            "[[:digit:][:upper:]]+", "\\x41\\u0042",
+            "\\.\\*\\(\\)", "(\\w+)@(\\w+)\\.com", "\\S+\\s\\S+",
+            "x$", "^x", ".*", "a.c", "\\W+"
+        };
+        const char* inputs[] = {
+            "", "a", "abcd", "xxxy", "aaaa", "> > ==name==", "abcxyz",
+            "]]a", "a]]", "--aa-", "12.345", "a word here", "for word",
+            "a{,2}", ".*()", "me@example.com", "foo bar", "x", "yx",
+            "AB", "a\nc", "axc", "!!!ab", "ABC123"
+        };
+
+        for (auto pattern : patterns) {
+            plux::regex re(pattern);
+            std::regex std_re(pattern);
+            for (auto input : inputs) {
+                std::string line(input);
+                std::string msg = std::string(pattern) + " on " + input;
+
+                std::smatch std_m;
+                bool std_res = std::regex_search(line, std_m, std_re);
+                plux::smatch m;
+                ASSERT_EQUAL(msg, std_res, plux::regex_search(line, m, re));
+                if (! std_res) {
+                    continue;
+                }
+                ASSERT_EQUAL(msg, std_m.size(), m.size());
+                for (size_t i = 0; i < m.size(); i++) {
+                    ASSERT_EQUAL(msg + " " + std::to_string(i),
+                                 std_m[i].str(), m[i].str());
+                }
+                ASSERT_EQUAL(msg + " (match)", std::regex_match(line, std_re),
+                             plux::regex_match(line, re));
+            }
+        }
+    }
+
+    /**
+     * Patterns that backtrack exponentially complete without delay.
+     */
+    void test_nfa_linear()
+    {
+        std::string line(5000, 'a');
+        plux::regex re("(a*)*b");
+        ASSERT_FALSE("nested star", plux::regex_search(line, re));
+        plux::regex re_alt("^(a|aa)+$");
+        ASSERT_TRUE("alternation", plux::regex_search(line, re_alt));
+        plux::regex re_opt("(a?){30}a{30}");
+        ASSERT_TRUE("optional", plux::regex_match(std::string(30, 'a'),
+                                                  re_opt));
+    }
+
+    void test_nfa_error()
+    {
+        const char* invalid[] = {
+            "(a", "a)", "[a", "*a", "a**", "\\1", "(?=a)", "a{3,2}",
+            "[z-a]", "\\", "[[:nope:]]"
+        };
+        for (auto pattern : invalid) {
+            bool error = false;
+            try {
+                plux::regex re(pattern);
+            } catch (const plux::regex_error&) {
+                error = true;
+            }
+            ASSERT_TRUE(pattern, error);
+        }
+    }
+#endif // USE_NFA_REGEX
 };
 
 int main(int argc, char* argv[])
 {
     try {
         TestRegex test_str;
-        TestSuite::main(argc, argv);
-        return 0;
+        return TestSuite::main(argc, argv);
     } catch (plux::PluxException& ex) {
         std::cerr << ex.to_string() << std::endl;
         return 1;
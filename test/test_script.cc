@@ -17,7 +17,9 @@ public:
         : _name("my-shell"),
           _timeout_ms(-1),
           _is_alive(true),
-          _exitstatus(-1)
+          _exitstatus(-1),
+          _line_cursor(0),
+          _line_matched(false)
     {
     }
 
@@ -59,7 +61,44 @@ public:
 
     virtual line_it line_begin() override { return _lines.begin(); }
     virtual line_it line_end() override { return _lines.end(); }
-    virtual void line_consume_until(line_it it) override { }
+    virtual void line_consume_until(line_it it) override {
+        _lines.erase(_lines.begin(), it);
+        line_match_reset();
+    }
+    virtual std::vector<std::string> line_tail(size_t num) const override {
+        return std::vector<std::string>();
+    }
+    virtual uint64_t lines_dropped() const override { return 0; }
+    virtual uint64_t bytes_dropped() const override { return 0; }
+    virtual size_t line_cursor() const override { return _line_cursor; }
+    virtual void set_line_cursor(size_t cursor) override {
+        _line_cursor = cursor;
+    }
+    virtual void set_line_match(const std::string& pattern,
+                                const plux::RegexCache::regex_ptr& re)
+        override {
+        _line_match.arm(pattern, re);
+    }
+    virtual bool line_matched() const override { return _line_matched; }
+    virtual void line_match_reset() override {
+        _line_cursor = 0;
+        _line_match.disarm();
+        _line_matched = false;
+    }
+
+    void add_line(const std::string& line) { _lines.push_back(line); }
+    /** Add line, testing the pending match like ProcessBase::output. */
+    void add_line(plux::ShellEnv& env, const std::string& line) {
+        _lines.push_back(line);
+        if (_line_match.armed() && ! _line_matched) {
+            _line_matched = _line_match.match_line(env, _name, line);
+            if (! _line_matched) {
+                _line_cursor = _lines.size();
+            }
+        }
+    }
+    const plux::ShellMatch& line_match() const { return _line_match; }
+    size_t num_lines() const { return _lines.size(); }
 
     virtual const std::string& buf() const override {
         return plux::empty_string;
@@ -73,6 +112,9 @@ private:
     int _exitstatus;
     std::string _error_pattern;
     plux::ShellCtx::line_vector _lines;
+    size_t _line_cursor;
+    plux::ShellMatch _line_match;
+    bool _line_matched;
 
     std::vector<std::string> _input;
 };
@@ -88,6 +130,8 @@ public:
                       std::bind(&TestLine::test_expand_var, this));
         register_test("append_var_val",
                       std::bind(&TestLine::test_append_var_val, this));
+        register_test("var_template",
+                      std::bind(&TestLine::test_var_template, this));
     }
 
     virtual ~TestLine() { }
@@ -166,6 +210,46 @@ public:
         ASSERT_EQUAL("escaped value", val_escaped, res_escaped);
     }
 
+    void test_var_template()
+    {
+        plux::env_map os_env;
+        plux::ShellEnvImpl env(os_env);
+        env.set_env("", "A", plux::VAR_SCOPE_GLOBAL, "a.b");
+
+        std::string buf;
+        plux::VarTemplate dollar("cost $$5 ^end$");
+        ASSERT_FALSE("dollar", dollar.is_literal());
+        ASSERT_EQUAL("dollar", "cost $5 ^end$", dollar.expand(env, "shell"));
+        // no variables, source string is used as is
+        plux::VarTemplate literal("^end$");
+        ASSERT_TRUE("literal", literal.is_literal());
+        ASSERT_TRUE("literal",
+                    &literal.str() == &literal.expand(env, "shell", buf));
+
+        plux::VarTemplate vars("$A$A ${=A}$");
+        ASSERT_EQUAL("vars", "a.ba.b a\\.b$", vars.expand(env, "shell"));
+
+        // expanded again, values are looked up on each expansion
+        env.set_env("", "A", plux::VAR_SCOPE_GLOBAL, "c");
+        ASSERT_EQUAL("vars", "cc c$", vars.expand(env, "shell", buf));
+
+        // errors are reported in order when expanded
+        plux::VarTemplate undefined("$UNDEFINED $ invalid");
+        try {
+            undefined.expand(env, "shell");
+            ASSERT_EQUAL("undefined", false, true);
+        } catch (plux::UndefinedException& ex) {
+        }
+        plux::VarTemplate invalid("$A $ invalid");
+        try {
+            invalid.expand(env, "my-shell");
+            ASSERT_EQUAL("invalid", false, true);
+        } catch (plux::ScriptError& ex) {
+            ASSERT_EQUAL("invalid", "my-shell", ex.shell());
+            ASSERT_EQUAL("invalid", "empty variable name", ex.error());
+        }
+    }
+
     virtual std::string to_string() const override { return "TestLine"; }
 };
 
@@ -343,6 +427,17 @@ public:
     {
         register_test("match",
                       std::bind(&TestLineRegexMatch::test_match, this));
+        register_test("run_cursor",
+                      std::bind(&TestLineRegexMatch::test_run_cursor, this));
+        register_test("run_line_match",
+                      std::bind(&TestLineRegexMatch::test_run_line_match,
+                                this));
+        register_test("run_line_match_function",
+                      std::bind(&TestLineRegexMatch::
+                                test_run_line_match_function, this));
+        register_test("expand_cache",
+                      std::bind(&TestLineRegexMatch::test_expand_cache,
+                                this));
     }
     virtual ~TestLineRegexMatch() { }
 
@@ -391,6 +486,118 @@ public:
         ASSERT_EQUAL("extract group", true, env.get_env("shell", "2", val));
         ASSERT_EQUAL("extract group", "2021", val);
     }
+
+    void test_run_cursor()
+    {
+        ShellCtxTest ctx;
+        plux::env_map os_env;
+        plux::ShellEnvImpl env(os_env);
+
+        set_pattern("^line [0-9]+$");
+        ctx.add_line("noise");
+        ctx.add_line("more noise");
+        ASSERT_EQUAL("no match", plux::RES_NO_MATCH, run(ctx, env).status());
+        ASSERT_EQUAL("no match", 2, ctx.line_cursor());
+
+        // checked lines are not tested again while the match is pending
+        set_pattern("noise");
+        ASSERT_EQUAL("checked", plux::RES_NO_MATCH, run(ctx, env).status());
+
+        set_pattern("^line [0-9]+$");
+        ctx.add_line("line 1");
+        ctx.add_line("line 2");
+        ASSERT_EQUAL("match", plux::RES_OK, run(ctx, env).status());
+        ASSERT_EQUAL("match", 1, ctx.num_lines());
+        ASSERT_EQUAL("match", 0, ctx.line_cursor());
+
+        ASSERT_EQUAL("match next", plux::RES_OK, run(ctx, env).status());
+        ASSERT_EQUAL("match next", 0, ctx.num_lines());
+    }
+
+    void test_run_line_match()
+    {
+        ShellCtxTest ctx;
+        plux::env_map os_env;
+        plux::ShellEnvImpl env(os_env);
+
+        set_pattern("^value ([0-9]+)$");
+        ASSERT_EQUAL("pending", plux::RES_NO_MATCH, run(ctx, env).status());
+        ASSERT_TRUE("pending", ctx.line_match().armed());
+        ASSERT_EQUAL("pending", "^value ([0-9]+)$",
+                     ctx.line_match().pattern());
+
+        ctx.add_line(env, "noise");
+        ctx.add_line(env, "value 42");
+        ctx.add_line(env, "value 43");
+        ASSERT_TRUE("matched on read", ctx.line_matched());
+        ASSERT_EQUAL("matched on read", 1, ctx.line_cursor());
+        std::string val;
+        ASSERT_TRUE("matched on read", env.get_env("my-shell", "1", val));
+        ASSERT_EQUAL("matched on read", "42", val);
+
+        ASSERT_EQUAL("run", plux::RES_OK, run(ctx, env).status());
+        ASSERT_EQUAL("run", 1, ctx.num_lines());
+        ASSERT_FALSE("run", ctx.line_match().armed());
+        ASSERT_FALSE("run", ctx.line_matched());
+    }
+
+    void test_run_line_match_function()
+    {
+        ShellCtxTest ctx;
+        plux::env_map os_env;
+        plux::ShellEnvImpl env(os_env);
+        env.set_env("", "word", plux::VAR_SCOPE_GLOBAL, "wrong");
+
+        // armed in the function scope, lines are read outside of it
+        set_pattern("^got $word$");
+        env.push_function();
+        env.set_env("", "word", plux::VAR_SCOPE_FUNCTION, "right");
+        ASSERT_EQUAL("pending", plux::RES_NO_MATCH, run(ctx, env).status());
+        ASSERT_EQUAL("pending", "^got right$", ctx.line_match().pattern());
+        env.pop_function();
+
+        ctx.add_line(env, "got wrong");
+        ASSERT_FALSE("global", ctx.line_matched());
+        ctx.add_line(env, "got right");
+        ASSERT_TRUE("argument", ctx.line_matched());
+        ASSERT_EQUAL("argument", 1, ctx.line_cursor());
+    }
+
+    void test_expand_cache()
+    {
+        plux::env_map os_env;
+        plux::ShellEnvImpl env(os_env);
+        env.set_env("", "V", plux::VAR_SCOPE_GLOBAL, "1");
+
+        set_pattern("^value ${V}$");
+        ASSERT_TRUE("expand", match(env, "shell", "value 1", true));
+        ASSERT_TRUE("cached", match(env, "shell", "value 1", true));
+
+        // expanded again when the variable changes
+        env.set_env("", "V", plux::VAR_SCOPE_GLOBAL, "2");
+        ASSERT_FALSE("global", match(env, "shell", "value 1", true));
+        ASSERT_TRUE("global", match(env, "shell", "value 2", true));
+
+        // ...and when matching in another shell or function scope
+        env.set_env("other", "V", plux::VAR_SCOPE_SHELL, "3");
+        ASSERT_TRUE("shell", match(env, "other", "value 3", true));
+        ASSERT_TRUE("shell", match(env, "shell", "value 2", true));
+
+        env.push_function();
+        env.set_env("", "V", plux::VAR_SCOPE_FUNCTION, "4");
+        ASSERT_TRUE("function", match(env, "shell", "value 4", true));
+        env.pop_function();
+        env.push_function();
+        ASSERT_TRUE("new function", match(env, "shell", "value 2", true));
+        env.pop_function();
+
+        // group variables set by the match itself
+        set_pattern("^([a-z]+) ${1}$");
+        env.set_env("shell", "1", plux::VAR_SCOPE_SHELL, "a");
+        ASSERT_TRUE("group", match(env, "shell", "b a", true));
+        ASSERT_TRUE("group", match(env, "shell", "c b", true));
+        ASSERT_FALSE("group", match(env, "shell", "d b", true));
+    }
 };
 
 class TestLineTimeout : public plux::LineTimeout,
@@ -4,6 +4,7 @@
 #include "test.hh"
 #include "script_parse.hh"
 #include "script_header.hh"
+#include "script_run.hh"
 
 class TestScriptParseCtx : public plux::ScriptParseCtx,
                            public TestSuite {
@@ -97,6 +98,8 @@ public:
         register_test("parse_function",
                       std::bind(&TestScriptParse::test_parse_function, this));
 
+        register_test("parse_parallel",
+                      std::bind(&TestScriptParse::test_parse_parallel, this));
         register_test("parse_header_require",
                       std::bind(&TestScriptParse::test_parse_config, this));
         register_test("parse_shell",
@@ -200,6 +203,62 @@ public:
         delete line;
     }
 
+    void test_parse_parallel()
+    {
+        plux::ScriptEnv env;
+        plux::Script script(":memory:", env);
+
+        std::istringstream is1("[shell sh1]\n"
+                               "!echo sh1\n"
+                               "[process sh2 cat]\n"
+                               "!sh2\n"
+                               "?sh2\n"
+                               "[shell sh1]\n"
+                               "?sh1\n"
+                               "[endparallel]\n");
+        set_is(&is1);
+        auto line = parse_parallel(ctx("[parallel]"), script);
+        auto parallel = dynamic_cast<plux::LineParallel*>(line);
+        ASSERT_NOT_NULL("parallel", parallel);
+        ASSERT_EQUAL("shells", 2,
+                     parallel->branch_end() - parallel->branch_begin());
+        auto branch = parallel->branch_begin();
+        ASSERT_EQUAL("sh1", "sh1", branch->first);
+        ASSERT_EQUAL("sh1", 2, branch->second.size());
+        ASSERT_EQUAL("sh1", "sh1", branch->second[1]->shell());
+        ++branch;
+        ASSERT_EQUAL("sh2", "sh2", branch->first);
+        ASSERT_EQUAL("sh2", 2, branch->second.size());
+        std::vector<std::string> args;
+        plux::ShellEnvImpl shell_env(plux::env_map{});
+        ASSERT_EQUAL("sh2 process", true,
+                     script.process_get(shell_env, "sh2", args));
+        delete line;
+
+        std::istringstream is2("!echo no shell\n"
+                               "[endparallel]\n");
+        set_is(&is2);
+        try {
+            parse_parallel(ctx("[parallel]"), script);
+            ASSERT_EQUAL("no shell", false, true);
+        } catch (plux::ScriptParseError& ex) {
+            ASSERT_EQUAL("no shell",
+                         "unexpected content, expected [shell name]",
+                         ex.error());
+        }
+
+        std::istringstream is3("[shell sh1]\n"
+                               "!echo sh1\n");
+        set_is(&is3);
+        try {
+            parse_parallel(ctx("[parallel]"), script);
+            ASSERT_EQUAL("missing end", false, true);
+        } catch (plux::ScriptParseError& ex) {
+            ASSERT_EQUAL("missing end",
+                         "EOF while scanning for [endparallel]", ex.error());
+        }
+    }
+
     void test_parse_config()
     {
         auto line = parse_config(ctx("[config require V1]"), nullptr);
@@ -10,6 +10,15 @@ public:
     {
         register_test("get_env",
                       std::bind(&TestShellEnvImpl::test_get_env, this));
+        register_test("lookup_env",
+                      std::bind(&TestShellEnvImpl::test_lookup_env, this));
+        register_test("version",
+                      std::bind(&TestShellEnvImpl::test_version, this));
+        register_test("os_envp",
+                      std::bind(&TestShellEnvImpl::test_os_envp, this));
+        register_test("swap_function",
+                      std::bind(&TestShellEnvImpl::test_swap_function,
+                                this));
     }
 
     void test_get_env()
@@ -20,6 +29,8 @@ public:
 
         ASSERT_EQUAL("os", true, get_env("", "key", val));
         ASSERT_EQUAL("os", "os-val", val);
+        ASSERT_EQUAL("default", true, get_env("", "_TAB_", val));
+        ASSERT_EQUAL("default", "\t", val);
 
         set_env("", "key", plux::VAR_SCOPE_GLOBAL, "global-val");
         ASSERT_EQUAL("global", true, get_env("", "key", val));
@@ -44,6 +55,82 @@ public:
         ASSERT_EQUAL("pop function", true, get_env("sh1", "key", val));
         ASSERT_EQUAL("pop function", "sh1-val", val);
     }
+
+    void test_lookup_env()
+    {
+        plux::var_id id = plux::var_names().intern("lookup-key");
+        ASSERT_TRUE("unset", lookup_env("", id) == nullptr);
+
+        set_env("", "lookup-key", plux::VAR_SCOPE_GLOBAL, "global-val");
+        const std::string* val = lookup_env("sh1", id);
+        ASSERT_TRUE("global", val != nullptr);
+        ASSERT_EQUAL("global", "global-val", *val);
+        ASSERT_TRUE("reference", val == lookup_env("sh2", id));
+
+        set_env("sh1", id, plux::VAR_SCOPE_SHELL, "sh1-val");
+        ASSERT_EQUAL("shell", "sh1-val", *lookup_env("sh1", id));
+        ASSERT_EQUAL("shell, fallback", "global-val", *lookup_env("sh2", id));
+    }
+
+    void test_version()
+    {
+        plux::var_id id = plux::var_names().intern("version-key");
+        ASSERT_EQUAL("unset", 0, version(id));
+
+        set_env("", id, plux::VAR_SCOPE_GLOBAL, "val");
+        uint64_t global_version = version(id);
+        ASSERT_TRUE("set", global_version > 0);
+        set_env("sh1", id, plux::VAR_SCOPE_SHELL, "val");
+        ASSERT_TRUE("set shell", version(id) > global_version);
+
+        ASSERT_EQUAL("scope", 0, scope());
+        push_function();
+        uint64_t fun_scope = scope();
+        ASSERT_TRUE("push", fun_scope > 0);
+        push_function();
+        ASSERT_TRUE("push nested", scope() != fun_scope);
+        pop_function();
+        ASSERT_EQUAL("pop", fun_scope, scope());
+        pop_function();
+        ASSERT_EQUAL("pop", 0, scope());
+    }
+
+    void test_os_envp()
+    {
+        char* const* envp = os_envp();
+        ASSERT_EQUAL("envp", "ENV=/dev/null", std::string(envp[0]));
+        ASSERT_EQUAL("envp", "PS1=SH-PROMPT:", std::string(envp[1]));
+        ASSERT_EQUAL("envp", "key=os-val", std::string(envp[2]));
+        ASSERT_TRUE("envp", envp[3] == nullptr);
+
+        // OS environment is not affected by script variables
+        set_env("", "key", plux::VAR_SCOPE_GLOBAL, "global-val");
+        ASSERT_EQUAL("os_get", "os-val", *os_get("key"));
+        ASSERT_TRUE("os_get", os_get("missing") == nullptr);
+        ASSERT_TRUE("envp", envp == os_envp());
+    }
+
+    void test_swap_function()
+    {
+        std::string val;
+
+        push_function();
+        set_env("", "fun-key", plux::VAR_SCOPE_FUNCTION, "task1-val");
+
+        function_stack task2;
+        swap_function(task2);
+        ASSERT_EQUAL("swapped out", false, get_env("", "fun-key", val));
+        push_function();
+        set_env("", "fun-key", plux::VAR_SCOPE_FUNCTION, "task2-val");
+        ASSERT_EQUAL("task2", true, get_env("", "fun-key", val));
+        ASSERT_EQUAL("task2", "task2-val", val);
+
+        swap_function(task2);
+        ASSERT_EQUAL("swapped in", true, get_env("", "fun-key", val));
+        ASSERT_EQUAL("swapped in", "task1-val", val);
+        ASSERT_EQUAL("task2 stack", 1, task2.size());
+        pop_function();
+    }
 };
 
 int main(int argc, char* argv[])
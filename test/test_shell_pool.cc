@@ -0,0 +1,209 @@
+#include "test.hh"
+#include "poller.hh"
+#include "script_run.hh"
+#include "shell_pool.hh"
+
+extern "C" {
+#include <sys/wait.h>
+#include <errno.h>
+}
+
+/**
+ * Log discarding all messages.
+ */
+class NullLog : public plux::Log {
+public:
+    NullLog()
+        : plux::Log(plux::LOG_LEVEL_ERROR)
+    {
+    }
+    virtual ~NullLog() { }
+
+protected:
+    virtual void write(enum plux::log_level, const std::string&) override { }
+};
+
+/**
+ * ProgressLog discarding all messages.
+ */
+class NullProgressLog : public plux::ProgressLog {
+public:
+    virtual ~NullProgressLog() { }
+
+    virtual void log(const std::string&, const std::string&) override { }
+};
+
+class TestShellPool : public TestSuite {
+public:
+    TestShellPool()
+        : TestSuite("ShellPool"),
+          _env(plux::env_map{{"PATH", "/bin:/usr/bin"}})
+    {
+        register_test("take_empty",
+                      std::bind(&TestShellPool::test_take_empty, this));
+        register_test("fill_take",
+                      std::bind(&TestShellPool::test_fill_take, this));
+        register_test("reap",
+                      std::bind(&TestShellPool::test_reap, this));
+        register_test("clear",
+                      std::bind(&TestShellPool::test_clear, this));
+        register_test("ready",
+                      std::bind(&TestShellPool::test_ready, this));
+    }
+
+    void test_take_empty()
+    {
+        plux::ShellPool pool(_log, _progress_log, "/bin/sh", _env);
+        ASSERT_TRUE("no size", pool.take("sh", &_shell_log) == nullptr);
+        pool.fill();
+        ASSERT_EQUAL("no size", 0, pool.num_shells());
+        ASSERT_TRUE("no size", pool.take("sh", &_shell_log) == nullptr);
+    }
+
+    void test_fill_take()
+    {
+        plux::ShellPool pool(_log, _progress_log, "/bin/sh", _env);
+        pool.set_size(2);
+        pool.fill();
+        ASSERT_EQUAL("fill", 2, pool.num_shells());
+
+        plux::Shell* shell = pool.take("my-shell", &_shell_log);
+        ASSERT_TRUE("take", shell != nullptr);
+        ASSERT_EQUAL("take", "my-shell", shell->name());
+        ASSERT_TRUE("take", shell->pid() > 0);
+        ASSERT_EQUAL("take", 1, pool.num_shells());
+
+        pool.fill();
+        ASSERT_EQUAL("refill", 2, pool.num_shells());
+        plux::Shell* next = pool.take("next", &_shell_log);
+        ASSERT_TRUE("refill", next != nullptr);
+        ASSERT_TRUE("refill", next->pid() != shell->pid());
+
+        delete next;
+        delete shell;
+    }
+
+    void test_reap()
+    {
+        // shells exiting at once, as if they died before being used
+        plux::ShellPool pool(_log, _progress_log, "/bin/true", _env);
+        pool.set_size(2);
+        pool.fill();
+        ASSERT_EQUAL("fill", 2, pool.num_shells());
+
+        for (size_t i = 0; i < 2; i++) {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            ASSERT_TRUE("exited", pid > 0);
+            ASSERT_TRUE("reap", pool.reap(pid));
+            ASSERT_FALSE("reap again", pool.reap(pid));
+        }
+        ASSERT_EQUAL("reaped", 0, pool.num_shells());
+        ASSERT_FALSE("unknown pid", pool.reap(1));
+    }
+
+    void test_clear()
+    {
+        {
+            plux::ShellPool pool(_log, _progress_log, "/bin/sh", _env);
+            pool.set_size(2);
+            pool.fill();
+            pool.clear();
+            ASSERT_EQUAL("clear", 0, pool.num_shells());
+
+            pool.fill();
+            ASSERT_EQUAL("clear", 2, pool.num_shells());
+        }
+
+        // shells were stopped and waited for on teardown
+        int status;
+        ASSERT_EQUAL("teardown", -1, waitpid(-1, &status, WNOHANG));
+        ASSERT_EQUAL("teardown", ECHILD, errno);
+    }
+
+    void test_ready()
+    {
+        plux::PollPoller poller;
+        plux::ShellPool pool(_log, _progress_log, "/bin/sh", _env);
+        pool.set_poller(&poller);
+        pool.set_size(2);
+        pool.fill();
+        ASSERT_EQUAL("started", 0, pool.num_ready());
+
+        poll_until(poller, pool, 2);
+        ASSERT_EQUAL("ready", 2, pool.num_ready());
+
+        // output read in the pool is kept for the script to match
+        StringShellLog shell_log;
+        plux::Shell* shell = pool.take("sh", &shell_log);
+        ASSERT_TRUE("take", shell != nullptr);
+        ASSERT_EQUAL("take", 1, pool.num_ready());
+        ASSERT_TRUE("take", shell->buf().find("SH-PROMPT:")
+                    != std::string::npos);
+        ASSERT_TRUE("take", shell_log.data().find("SH-PROMPT:")
+                    != std::string::npos);
+
+        // taken shell is still polled, output is not passed to the pool
+        shell->input("echo taken\n");
+        bool taken = false;
+        while (! taken && poller.wait(5000) > 0) {
+            plux::PollerInput input;
+            while (poller.next_input(input)) {
+                ASSERT_FALSE("polled", pool.output(input.fd, input.data,
+                                                   input.size));
+                shell->output(input.data, input.size);
+                taken = shell_log.data().find("taken\r\n")
+                    != std::string::npos;
+            }
+        }
+        ASSERT_TRUE("polled", taken);
+        poller.remove(shell->fd_input());
+        delete shell;
+    }
+
+private:
+    /**
+     * Shell log keeping output.
+     */
+    class StringShellLog : public plux::ShellLog {
+    public:
+        virtual ~StringShellLog() { }
+
+        const std::string& data() const { return _data; }
+
+        virtual void input(const std::string&) override { }
+        virtual void output(const char* data, ssize_t size) override {
+            _data.append(data, size);
+        }
+
+    private:
+        std::string _data;
+    };
+
+    void poll_until(plux::Poller& poller, plux::ShellPool& pool,
+                    size_t num_ready)
+    {
+        while (pool.num_ready() < num_ready && poller.wait(5000) > 0) {
+            plux::PollerInput input;
+            while (poller.next_input(input)) {
+                pool.output(input.fd, input.data, input.size);
+            }
+        }
+    }
+
+    NullLog _log;
+    plux::NullShellLog _shell_log;
+    NullProgressLog _progress_log;
+    plux::ShellEnvImpl _env;
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        TestShellPool test_shell_pool;
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,152 @@
+#include <cstdio>
+#include <fstream>
+
+#include "test.hh"
+#include "plux.hh"
+#include "timing_db.hh"
+
+class TestTimingDb : public TestSuite {
+public:
+    TestTimingDb()
+        : TestSuite("TimingDb")
+    {
+        register_test("get_set",
+                      std::bind(&TestTimingDb::test_get_set, this));
+        register_test("save_load",
+                      std::bind(&TestTimingDb::test_save_load, this));
+        register_test("load_invalid",
+                      std::bind(&TestTimingDb::test_load_invalid, this));
+        register_test("shard_files",
+                      std::bind(&TestTimingDb::test_shard_files, this));
+        register_test("schedule_longest_first",
+                      std::bind(&TestTimingDb::test_schedule_longest_first,
+                                this));
+    }
+
+    void test_get_set()
+    {
+        plux::TimingDb db("test_timing_db.db");
+        uint64_t elapsed_ms = 0;
+        ASSERT_EQUAL("missing", false, db.get("a.plux", elapsed_ms));
+        db.set("a.plux", 1200);
+        ASSERT_EQUAL("set", true, db.get("a.plux", elapsed_ms));
+        ASSERT_EQUAL("set", 1200, elapsed_ms);
+        db.set("a.plux", 800);
+        ASSERT_EQUAL("overwrite", true, db.get("a.plux", elapsed_ms));
+        ASSERT_EQUAL("overwrite", 800, elapsed_ms);
+    }
+
+    void test_save_load()
+    {
+        const char *path = "test_timing_db_save.db";
+        plux::TimingDb db(path);
+        db.set("a.plux", 100);
+        db.set("dir/with space.plux", 2000);
+        ASSERT_EQUAL("save", true, db.save());
+
+        plux::TimingDb db_load(path);
+        ASSERT_EQUAL("load", true, db_load.load());
+        ASSERT_EQUAL("load", 2, db_load.size());
+        uint64_t elapsed_ms = 0;
+        ASSERT_EQUAL("load", true, db_load.get("a.plux", elapsed_ms));
+        ASSERT_EQUAL("load", 100, elapsed_ms);
+        ASSERT_EQUAL("load", true,
+                     db_load.get("dir/with space.plux", elapsed_ms));
+        ASSERT_EQUAL("load", 2000, elapsed_ms);
+        remove(path);
+
+        plux::TimingDb db_missing(path);
+        ASSERT_EQUAL("missing", false, db_missing.load());
+    }
+
+    void test_load_invalid()
+    {
+        const char *path = "test_timing_db_invalid.db";
+        {
+            std::ofstream os(path);
+            os << "100 a.plux\n"
+               << "invalid\n"
+               << "abc b.plux\n"
+               << " c.plux\n"
+               << "300 \n"
+               << "400 d.plux\n";
+        }
+        plux::TimingDb db(path);
+        ASSERT_EQUAL("load", true, db.load());
+        ASSERT_EQUAL("valid entries", 2, db.size());
+        remove(path);
+    }
+
+    void test_shard_files()
+    {
+        std::vector<std::string> files = {"a.plux", "b.plux", "c.plux",
+                                          "d.plux", "e.plux", "f.plux"};
+        plux::TimingDb db("test_timing_db.db");
+        db.set("a.plux", 1000);
+        db.set("b.plux", 6000);
+        db.set("c.plux", 2000);
+        db.set("d.plux", 3000);
+        db.set("e.plux", 4000);
+
+        // b 6000, a 1000 | e 4000, c 2000 | f 3200 (average), d 3000
+        auto s1 = plux::shard_files(files, db, 1, 3);
+        auto s2 = plux::shard_files(files, db, 2, 3);
+        auto s3 = plux::shard_files(files, db, 3, 3);
+        ASSERT_EQUAL("shard 1", 2, s1.size());
+        ASSERT_EQUAL("shard 1", "a.plux", s1[0]);
+        ASSERT_EQUAL("shard 1", "b.plux", s1[1]);
+        ASSERT_EQUAL("shard 2", 2, s2.size());
+        ASSERT_EQUAL("shard 2", "c.plux", s2[0]);
+        ASSERT_EQUAL("shard 2", "e.plux", s2[1]);
+        ASSERT_EQUAL("shard 3", 2, s3.size());
+        ASSERT_EQUAL("shard 3", "d.plux", s3[0]);
+        ASSERT_EQUAL("shard 3", "f.plux", s3[1]);
+
+        // independent of input order
+        std::vector<std::string> rfiles(files.rbegin(), files.rend());
+        auto rs3 = plux::shard_files(rfiles, db, 3, 3);
+        ASSERT_EQUAL("reversed", 2, rs3.size());
+        ASSERT_EQUAL("reversed", "f.plux", rs3[0]);
+        ASSERT_EQUAL("reversed", "d.plux", rs3[1]);
+
+        // no durations, split evenly
+        plux::TimingDb db_empty("test_timing_db.db");
+        ASSERT_EQUAL("empty db", 3,
+                     plux::shard_files(files, db_empty, 1, 2).size());
+        ASSERT_EQUAL("empty db", 3,
+                     plux::shard_files(files, db_empty, 2, 2).size());
+
+        ASSERT_EQUAL("invalid shard", 0,
+                     plux::shard_files(files, db, 4, 3).size());
+    }
+
+    void test_schedule_longest_first()
+    {
+        std::vector<std::string> files = {"a.plux", "b.plux", "c.plux",
+                                          "d.plux", "e.plux"};
+        plux::TimingDb db("test_timing_db.db");
+        db.set("a.plux", 100);
+        db.set("b.plux", 3000);
+        db.set("d.plux", 100);
+        db.set("e.plux", 5000);
+
+        auto order = plux::schedule_longest_first(files, db);
+        ASSERT_EQUAL("size", 5, order.size());
+        ASSERT_EQUAL("unknown first", 2, order[0]);
+        ASSERT_EQUAL("longest", 4, order[1]);
+        ASSERT_EQUAL("longest", 1, order[2]);
+        ASSERT_EQUAL("equal, keep order", 0, order[3]);
+        ASSERT_EQUAL("equal, keep order", 3, order[4]);
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        TestTimingDb test_timing_db;
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}
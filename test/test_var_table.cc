@@ -0,0 +1,89 @@
+#include "test.hh"
+#include "plux.hh"
+#include "var_table.hh"
+
+class TestVarTable : public TestSuite {
+public:
+    TestVarTable()
+        : TestSuite("VarTable")
+    {
+        register_test("intern",
+                      std::bind(&TestVarTable::test_intern, this));
+        register_test("find",
+                      std::bind(&TestVarTable::test_find, this));
+        register_test("get_set",
+                      std::bind(&TestVarTable::test_get_set, this));
+    }
+
+    void test_intern()
+    {
+        plux::VarNames names;
+        plux::var_id a = names.intern("A");
+        plux::var_id b = names.intern("B");
+        ASSERT_EQUAL("first", 0, a);
+        ASSERT_EQUAL("second", 1, b);
+        ASSERT_EQUAL("existing", a, names.intern("A"));
+        ASSERT_EQUAL("size", 2, names.size());
+        ASSERT_EQUAL("name", "A", names.name(a));
+        ASSERT_EQUAL("name", "B", names.name(b));
+
+        // names stay valid as the table grows
+        const std::string& name_a = names.name(a);
+        for (int i = 0; i < 1000; i++) {
+            names.intern(std::to_string(i));
+        }
+        ASSERT_EQUAL("stable", "A", name_a);
+    }
+
+    void test_find()
+    {
+        plux::VarNames names;
+        ASSERT_EQUAL("missing", plux::VarNames::NONE, names.find("A"));
+        ASSERT_EQUAL("missing", 0, names.size());
+        plux::var_id id = names.intern("A");
+        ASSERT_EQUAL("interned", id, names.find("A"));
+    }
+
+    void test_get_set()
+    {
+        plux::VarTable table;
+        ASSERT_TRUE("empty", table.empty());
+        ASSERT_TRUE("unset", table.get(0) == nullptr);
+
+        table.set(3, "three");
+        ASSERT_EQUAL("size", 1, table.size());
+        ASSERT_TRUE("below", table.get(2) == nullptr);
+        ASSERT_TRUE("above", table.get(4) == nullptr);
+        ASSERT_EQUAL("set", "three", *table.get(3));
+
+        table.set(3, "");
+        ASSERT_EQUAL("overwrite", 1, table.size());
+        ASSERT_TRUE("empty value", table.get(3) != nullptr);
+        ASSERT_EQUAL("empty value", "", *table.get(3));
+
+        table.set(0, "zero");
+        ASSERT_EQUAL("size", 2, table.size());
+        ASSERT_EQUAL("set", "zero", *table.get(0));
+
+        // values stay valid as the table grows
+        const std::string* zero = table.get(0);
+        for (plux::var_id id = 4; id < 1000; id++) {
+            table.set(id, std::to_string(id));
+        }
+        ASSERT_TRUE("stable", zero == table.get(0));
+        ASSERT_EQUAL("stable", "zero", *zero);
+        table.set(0, "again");
+        ASSERT_EQUAL("set again", "again", *zero);
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        TestVarTable test_var_table;
+        return TestSuite::main(argc, argv);
+    } catch (plux::PluxException& ex) {
+        std::cerr << ex.to_string() << std::endl;
+        return 1;
+    }
+}